@@ -4,9 +4,14 @@
 #include <ctype.h>
 #include <regex.h>
 #include <limits.h>
+#include <time.h>
+#include "csv_stream.h"
+#include "validador_sku.h"
 
-#define MAX_LINE 1024
 #define MAX_FIELD 256
+#define MAX_CAMPOS 8
+#define SKU_PATRON "^[A-Z]{3}-[0-9]{4}$"
+#define BENCH_SKUS 4096               // SKUs distintos del microbenchmark
 
 typedef struct {
     char nombre[MAX_FIELD];
@@ -20,15 +25,36 @@ int validar_precio(const char *precio_str) {
     return *endptr == '\0' && precio > 0;
 }
 
+// Validador compilado en main a partir de SKU_PATRON
+static struct validador_sku validador;
+
 int validar_sku(const char *sku) {
+    return validador_sku_valido(&validador, sku);
+}
+
+// Ruta anterior: compila la expresión en cada llamada. Sólo para comparar
+int validar_sku_regex(const char *sku) {
     regex_t regex;
-    int reti = regcomp(&regex, "^[A-Z]{3}-[0-9]{4}$", REG_EXTENDED);
+    int reti = regcomp(&regex, SKU_PATRON, REG_EXTENDED);
     if (reti) return 0;
     reti = regexec(&regex, sku, 0, NULL, 0);
     regfree(&regex);
     return reti == 0;
 }
 
+// Copia de validar_sku de seekcaso7.c (formato AAA-00000) para el benchmark
+int validar_sku_seek(const char *sku) {
+    if (strnlen(sku, 32) != 9) return 0;
+    for (int i = 0; i < 3; i++) {
+        if (!isupper((unsigned char)sku[i])) return 0;
+    }
+    if (sku[3] != '-') return 0;
+    for (int i = 4; i < 9; i++) {
+        if (!isdigit((unsigned char)sku[i])) return 0;
+    }
+    return 1;
+}
+
 void cargar_csv(const char *ruta_csv) {
     FILE *fp = fopen(ruta_csv, "r");
     if (!fp) {
@@ -36,36 +62,48 @@ void cargar_csv(const char *ruta_csv) {
         return;
     }
 
-    char linea[MAX_LINE];
-    int fila = 0;
-    while (fgets(linea, sizeof(linea), fp)) {
-        fila++;
-        size_t len = strlen(linea);
-        if (len == sizeof(linea) - 1 && linea[len - 1] != '\n') {
-            fprintf(stderr, "Línea %d demasiado larga\n", fila);
-            continue; // evitar posibles overflows
+    struct csv_lector lector;
+    if (!csv_lector_abrir(&lector, fp)) {
+        fclose(fp);
+        return;
+    }
+
+    struct csv_campo campos[MAX_CAMPOS];
+    int num_campos;
+    int r;
+    while ((r = csv_lector_siguiente(&lector, campos, MAX_CAMPOS, &num_campos)) != CSV_FIN) {
+        long fila = lector.registro;
+        if (r != CSV_REGISTRO) {
+            fprintf(stderr, "Línea %ld inválida: CSV mal formado\n", fila);
+            continue;
         }
 
-        if (fila == 1 && strstr(linea, "nombre") && strstr(linea, "precio") && strstr(linea, "sku")) {
+        if (fila == 1 && num_campos == 3 && csv_campo_igual(&campos[0], "nombre") &&
+            csv_campo_igual(&campos[1], "precio") && csv_campo_igual(&campos[2], "sku")) {
             continue; // saltar encabezado
         }
 
-        char *nombre = strtok(linea, ",");
-        char *precio_str = strtok(NULL, ",");
-        char *sku = strtok(NULL, "\n");
+        if (num_campos != 3) {
+            fprintf(stderr, "Línea %ld inválida: campos incompletos\n", fila);
+            continue;
+        }
 
-        if (!nombre || !precio_str || !sku) {
-            fprintf(stderr, "Línea %d inválida: campos incompletos\n", fila);
+        // Un campo que no cabe se rechaza en lugar de truncarlo
+        char nombre[MAX_FIELD], precio_str[MAX_FIELD], sku[MAX_FIELD];
+        if (csv_copiar(&campos[0], nombre, sizeof(nombre)) >= sizeof(nombre) ||
+            csv_copiar(&campos[1], precio_str, sizeof(precio_str)) >= sizeof(precio_str) ||
+            csv_copiar(&campos[2], sku, sizeof(sku)) >= sizeof(sku)) {
+            fprintf(stderr, "Línea %ld demasiado larga\n", fila);
             continue;
         }
 
         if (!validar_precio(precio_str)) {
-            fprintf(stderr, "Línea %d inválida: precio no válido\n", fila);
+            fprintf(stderr, "Línea %ld inválida: precio no válido\n", fila);
             continue;
         }
 
         if (!validar_sku(sku)) {
-            fprintf(stderr, "Línea %d inválida: SKU no válido\n", fila);
+            fprintf(stderr, "Línea %ld inválida: SKU no válido\n", fila);
             continue;
         }
 
@@ -78,12 +116,95 @@ void cargar_csv(const char *ruta_csv) {
         // insertar_producto(db_conn, p);
     }
 
+    csv_lector_cerrar(&lector);
     fclose(fp);
 }
 
+static double ns_por_llamada(const struct timespec *inicio, long llamadas) {
+    struct timespec fin;
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    return ((fin.tv_sec - inicio->tv_sec) * 1e9 + (fin.tv_nsec - inicio->tv_nsec)) / llamadas;
+}
+
+// Mide una función de validación sobre la tabla de SKUs; devuelve los aceptados
+static long medir(const char *nombre, int (*validar)(const char *), char skus[][16], long llamadas) {
+    struct timespec inicio;
+    long aceptados = 0;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+    for (long i = 0; i < llamadas; i++) {
+        aceptados += validar(skus[i % BENCH_SKUS]);
+    }
+    printf("%-28s %10.1f ns/SKU  (%ld aceptados)\n", nombre, ns_por_llamada(&inicio, llamadas), aceptados);
+    return aceptados;
+}
+
+static regex_t regex_una_vez;
+
+static int validar_sku_regex_una_vez(const char *sku) {
+    return regexec(&regex_una_vez, sku, 0, NULL, 0) == 0;
+}
+
+static struct validador_sku validador_seek;
+
+static int validar_sku_dfa_seek(const char *sku) {
+    return validador_sku_valido(&validador_seek, sku);
+}
+
+// Compara el DFA con la expresión regular (por llamada y precompilada) y con
+// el validador escrito a mano de seekcaso7.c sobre una mezcla de SKUs
+static int bench_sku(long llamadas) {
+    static char skus[BENCH_SKUS][16];
+    unsigned int semilla = 1;
+    if (llamadas < 100) llamadas = 1000000;
+    for (int i = 0; i < BENCH_SKUS; i++) {
+        int digitos = 4 + (int)(rand_r(&semilla) % 2);
+        int n = snprintf(skus[i], sizeof(skus[i]), "%c%c%c-%0*d", 'A' + rand_r(&semilla) % 26,
+                         'A' + rand_r(&semilla) % 26, 'A' + rand_r(&semilla) % 26, digitos,
+                         (int)(rand_r(&semilla) % (digitos == 4 ? 10000 : 100000)));
+        switch (rand_r(&semilla) % 8) {
+            case 0: skus[i][rand_r(&semilla) % n] = 'a'; break;    // Minúscula o dígito fuera de sitio
+            case 1: skus[i][n - 1] = '\0'; break;                  // Demasiado corto
+            case 2: skus[i][3] = '_'; break;                       // Separador incorrecto
+            default: break;
+        }
+    }
+    if (regcomp(&regex_una_vez, SKU_PATRON, REG_EXTENDED | REG_NOSUB) != 0 ||
+        !validador_sku_compilar(&validador_seek, "^[A-Z]{3}-[0-9]{5}$")) {
+        return 1;
+    }
+
+    printf("Patrón %s (%d estados, %d clases de bytes)\n", SKU_PATRON, validador.num_estados, validador.num_clases);
+    medir("regcomp+regexec por SKU", validar_sku_regex, skus, llamadas / 100);
+    medir("regexec precompilado", validar_sku_regex_una_vez, skus, llamadas);
+    medir("DFA compilado", validar_sku, skus, llamadas);
+    printf("Patrón ^[A-Z]{3}-[0-9]{5}$ (validar_sku de seekcaso7.c)\n");
+    medir("validar_sku de seekcaso7.c", validar_sku_seek, skus, llamadas);
+    medir("DFA compilado", validar_sku_dfa_seek, skus, llamadas);
+
+    // Los validadores del mismo patrón deben aceptar exactamente los mismos SKUs
+    int distintos = 0;
+    for (int i = 0; i < BENCH_SKUS; i++) {
+        distintos += validar_sku(skus[i]) != validar_sku_regex_una_vez(skus[i]);
+        distintos += validar_sku_dfa_seek(skus[i]) != validar_sku_seek(skus[i]);
+    }
+    regfree(&regex_una_vez);
+    if (distintos) {
+        fprintf(stderr, "Los validadores no coinciden en %d SKUs\n", distintos);
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
+    if (!validador_sku_compilar(&validador, SKU_PATRON)) {
+        fprintf(stderr, "Patrón de SKU no admitido: %s\n", SKU_PATRON);
+        return 1;
+    }
+    if (argc == 3 && strcmp(argv[1], "--bench-sku") == 0) {
+        return bench_sku(atol(argv[2]));
+    }
     if (argc != 2) {
-        fprintf(stderr, "Uso: %s archivo.csv\n", argv[0]);
+        fprintf(stderr, "Uso: %s archivo.csv\n       %s --bench-sku <validaciones>\n", argv[0], argv[0]);
         return 1;
     }
 
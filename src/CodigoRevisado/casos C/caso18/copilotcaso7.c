@@ -3,8 +3,10 @@
 #include <string.h>
 #include <sqlite3.h>
 #include <ctype.h>
+#include "csv_stream.h"
 
-#define MAX_LINE 1024
+#define MAX_FIELD 256
+#define MAX_CAMPOS 8
 #define SKU_LENGTH 10
 
 // Función para validar que el precio es positivo
@@ -54,17 +56,28 @@ void leer_csv_y_cargar(const char *archivo_csv, sqlite3 *db) {
         return;
     }
 
-    char line[MAX_LINE];
-    while (fgets(line, sizeof(line), file)) {
-        // Prevención de buffer overflow: Garantizamos que la línea termina en '\0'
-        line[strcspn(line, "\n")] = '\0';
+    // Parser RFC 4180: admite comas, comillas y saltos de línea dentro de campos
+    struct csv_lector lector;
+    if (!csv_lector_abrir(&lector, file)) {
+        fclose(file);
+        return;
+    }
 
-        char *nombre = strtok(line, ",");
-        char *precio_str = strtok(NULL, ",");
-        char *sku = strtok(NULL, ",");
+    struct csv_campo campos[MAX_CAMPOS];
+    int num_campos;
+    int r;
+    while ((r = csv_lector_siguiente(&lector, campos, MAX_CAMPOS, &num_campos)) != CSV_FIN) {
+        if (r != CSV_REGISTRO || num_campos < 3) {
+            fprintf(stderr, "Línea malformada: registro %ld\n", lector.registro);
+            continue;
+        }
 
-        if (!nombre || !precio_str || !sku) {
-            fprintf(stderr, "Línea malformada: %s\n", line);
+        // Los campos se copian acotados; el SKU no se trunca para no validar otro distinto
+        char nombre[MAX_FIELD], precio_str[MAX_FIELD], sku[SKU_LENGTH + 2];
+        csv_copiar(&campos[0], nombre, sizeof(nombre));
+        csv_copiar(&campos[1], precio_str, sizeof(precio_str));
+        if (csv_copiar(&campos[2], sku, sizeof(sku)) >= sizeof(sku)) {
+            fprintf(stderr, "SKU inválido para producto '%s'\n", nombre);
             continue;
         }
 
@@ -82,6 +95,7 @@ void leer_csv_y_cargar(const char *archivo_csv, sqlite3 *db) {
         cargar_en_db(db, nombre, precio, sku);
     }
 
+    csv_lector_cerrar(&lector);
     fclose(file);
 }
 
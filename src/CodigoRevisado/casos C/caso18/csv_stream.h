@@ -0,0 +1,242 @@
+#ifndef CSV_STREAM_H
+#define CSV_STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Parser CSV (RFC 4180) en streaming para los cargadores de caso18.
+// Admite campos entre comillas con comas, saltos de línea y comillas escapadas
+// (""), y finales de línea LF o CRLF. Los campos se devuelven como trozos del
+// buffer de lectura, sin copiarlos; sólo los que contienen "" necesitan
+// csv_copiar para desescaparse. Los delimitadores y las comillas se localizan
+// comparando 16 bytes a la vez y recorriendo la máscara de bits resultante.
+
+#define CSV_BUFFER_INICIAL 65536
+#define CSV_MAX_REGISTRO (16 * 1024 * 1024)   // Registro más largo admitido
+
+enum csv_resultado {
+    CSV_FIN = 0,                      // No quedan registros
+    CSV_REGISTRO = 1,
+    CSV_INCOMPLETO = -1,              // Faltan datos para cerrar el registro
+    CSV_ERROR = -2                    // Registro mal formado (ya descartado)
+};
+
+struct csv_campo {
+    const char *datos;
+    size_t len;
+    bool escapado;                    // Contiene "" dentro de un campo entre comillas
+};
+
+// Posición del primer byte igual a a, b o c en p[0..n), o n si no hay ninguno
+static inline size_t csv_buscar(const char *p, size_t n, char a, char b, char c) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    for (; i + 16 <= n; i += 16) {
+        __m128i bloque = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i iguales = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bloque, va), _mm_cmpeq_epi8(bloque, vb)),
+                                       _mm_cmpeq_epi8(bloque, vc));
+        unsigned int mascara = (unsigned int)_mm_movemask_epi8(iguales);
+        if (mascara) {
+            return i + (size_t)__builtin_ctz(mascara);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (p[i] == a || p[i] == b || p[i] == c) {
+            return i;
+        }
+    }
+    return n;
+}
+
+// Salta hasta el siguiente salto de línea tras un registro erróneo
+static inline int csv_descartar(const char *datos, size_t len, size_t *pos, size_t desde) {
+    const char *nl = memchr(datos + desde, '\n', len - desde);
+    *pos = nl ? (size_t)(nl - datos) + 1 : len;
+    return CSV_ERROR;
+}
+
+// Analiza el registro que empieza en *pos. Con final = false un registro sin
+// terminar devuelve CSV_INCOMPLETO y *pos no avanza; con final = true el último
+// registro puede acabar sin salto de línea. Los campos que no caben en
+// max_campos hacen el registro erróneo.
+static inline int csv_analizar(const char *datos, size_t len, size_t *pos, bool final,
+                               struct csv_campo *campos, int max_campos, int *num_campos) {
+    size_t i = *pos;
+    int n = 0;
+    if (i >= len) {
+        return final ? CSV_FIN : CSV_INCOMPLETO;
+    }
+
+    while (1) {
+        if (n == max_campos) {
+            return csv_descartar(datos, len, pos, i);
+        }
+        struct csv_campo *campo = &campos[n++];
+        campo->escapado = false;
+
+        if (i < len && datos[i] == '"') {
+            // Campo entre comillas: sólo importa la siguiente comilla
+            size_t inicio = ++i;
+            while (1) {
+                i += csv_buscar(datos + i, len - i, '"', '"', '"');
+                if (i + 1 >= len) {
+                    if (!final) return CSV_INCOMPLETO;
+                    if (i >= len) return csv_descartar(datos, len, pos, inicio); // Comilla sin cerrar
+                }
+                if (i + 1 < len && datos[i + 1] == '"') {
+                    campo->escapado = true;
+                    i += 2;
+                    continue;
+                }
+                break;
+            }
+            campo->datos = datos + inicio;
+            campo->len = i - inicio;
+            i++; // Comilla de cierre
+            if ((i >= len || (datos[i] == '\r' && i + 1 >= len)) && !final) {
+                return CSV_INCOMPLETO;
+            }
+            if (i < len && datos[i] == '\r' && (i + 1 >= len || datos[i + 1] == '\n')) {
+                i++;
+            }
+            if (i < len && datos[i] != ',' && datos[i] != '\n') {
+                return csv_descartar(datos, len, pos, i);
+            }
+        } else {
+            // Campo sin comillas: no puede contener comillas (RFC 4180)
+            size_t inicio = i;
+            i += csv_buscar(datos + i, len - i, ',', '\n', '"');
+            if (i >= len && !final) {
+                return CSV_INCOMPLETO;
+            }
+            if (i < len && datos[i] == '"') {
+                return csv_descartar(datos, len, pos, i);
+            }
+            size_t fin = i;
+            if (fin > inicio && datos[fin - 1] == '\r' && (fin >= len || datos[fin] == '\n')) {
+                fin--;
+            }
+            campo->datos = datos + inicio;
+            campo->len = fin - inicio;
+        }
+
+        if (i >= len || datos[i] == '\n') {
+            *pos = (i >= len) ? len : i + 1;
+            *num_campos = n;
+            return CSV_REGISTRO;
+        }
+        i++; // Coma
+    }
+}
+
+// Inicio del primer registro en una posición >= objetivo, partiendo de desde,
+// que debe ser un inicio de registro. Sirve para dividir un fichero proyectado
+// en memoria en trozos que no corten campos con saltos de línea.
+static inline size_t csv_limite_registro(const char *datos, size_t len, size_t desde, size_t objetivo) {
+    bool entre_comillas = false;
+    size_t i = desde;
+    if (objetivo <= desde) return desde;
+    while (i < len) {
+        i += csv_buscar(datos + i, len - i, '"', '\n', '"');
+        if (i >= len) break;
+        if (datos[i] == '"') {
+            entre_comillas = !entre_comillas; // "" se anula a sí mismo
+        } else if (!entre_comillas && i + 1 >= objetivo) {
+            return i + 1;
+        }
+        i++;
+    }
+    return len;
+}
+
+// Copia el campo desescapado en dst (terminado en '\0'). Como snprintf,
+// devuelve la longitud completa aunque no quepa
+static inline size_t csv_copiar(const struct csv_campo *campo, char *dst, size_t cap) {
+    if (!campo->escapado) {
+        if (cap > 0) {
+            size_t n = campo->len < cap - 1 ? campo->len : cap - 1;
+            memcpy(dst, campo->datos, n);
+            dst[n] = '\0';
+        }
+        return campo->len;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < campo->len; i++) {
+        if (campo->datos[i] == '"') i++; // "" -> "
+        if (n + 1 < cap) dst[n] = campo->datos[i];
+        n++;
+    }
+    if (cap > 0) dst[n < cap ? n : cap - 1] = '\0';
+    return n;
+}
+
+static inline bool csv_campo_igual(const struct csv_campo *campo, const char *texto) {
+    size_t n = strlen(texto);
+    return !campo->escapado && campo->len == n && memcmp(campo->datos, texto, n) == 0;
+}
+
+// Lector en streaming sobre un FILE*: el buffer crece sólo si un registro no
+// cabe. Los campos devueltos son válidos hasta la siguiente llamada.
+struct csv_lector {
+    FILE *archivo;
+    char *buf;
+    size_t cap;
+    size_t pos;
+    size_t len;
+    bool eof;
+    long registro;                    // Número del último registro devuelto (desde 1)
+};
+
+static inline bool csv_lector_abrir(struct csv_lector *l, FILE *archivo) {
+    memset(l, 0, sizeof(*l));
+    l->archivo = archivo;
+    l->cap = CSV_BUFFER_INICIAL;
+    l->buf = malloc(l->cap);
+    return l->buf != NULL;
+}
+
+static inline void csv_lector_cerrar(struct csv_lector *l) {
+    free(l->buf);
+    l->buf = NULL;
+}
+
+static inline int csv_lector_siguiente(struct csv_lector *l, struct csv_campo *campos, int max_campos,
+                                       int *num_campos) {
+    while (1) {
+        int r = csv_analizar(l->buf, l->len, &l->pos, l->eof, campos, max_campos, num_campos);
+        if (r != CSV_INCOMPLETO) {
+            if (r != CSV_FIN) l->registro++;
+            return r;
+        }
+
+        // Lleva el registro incompleto al principio y lee más
+        memmove(l->buf, l->buf + l->pos, l->len - l->pos);
+        l->len -= l->pos;
+        l->pos = 0;
+        if (l->len == l->cap) {
+            if (l->cap >= CSV_MAX_REGISTRO) {
+                l->len = 0; // Registro desmesurado: se descarta lo acumulado
+                l->registro++;
+                return CSV_ERROR;
+            }
+            char *buf = realloc(l->buf, l->cap * 2);
+            if (!buf) return CSV_ERROR;
+            l->buf = buf;
+            l->cap *= 2;
+        }
+        size_t leidos = fread(l->buf + l->len, 1, l->cap - l->len, l->archivo);
+        l->len += leidos;
+        if (leidos == 0) l->eof = true;
+    }
+}
+
+#endif
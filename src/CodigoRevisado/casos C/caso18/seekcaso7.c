@@ -5,11 +5,23 @@
 #include <sqlite3.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include "csv_stream.h"
 
-#define MAX_LINE_LENGTH 1024
+#define MAX_CAMPOS 8                  // Un registro con más campos se descarta
+#define MAX_PRECIO_LENGTH 64
 #define MAX_NAME_LENGTH 256
 #define MAX_SKU_LENGTH 32
 #define MAX_SQL_LENGTH 512
+#define LOTE_POR_DEFECTO 10000        // Filas por transacción en modo masivo
+#define CACHE_MASIVO_KB 65536         // cache_size durante la carga masiva
+#define MAX_LECTORES 64
+#define SEGMENTO_BYTES (256 * 1024)   // Trozo de CSV que analiza cada lector de una vez
+#define COLA_LOTES 16                 // Lotes analizados pendientes de escribir
 
 typedef struct {
     char nombre[MAX_NAME_LENGTH];
@@ -38,23 +50,20 @@ int validar_sku(const char *sku) {
     return 1;
 }
 
-int procesar_linea_csv(const char *linea, Producto *producto) {
-    char copia_linea[MAX_LINE_LENGTH + 1] = {0};
-    safe_strcpy(copia_linea, linea, sizeof(copia_linea));
+// Valida un registro ya separado en campos (nombre, precio, sku)
+int procesar_registro_csv(const struct csv_campo *campos, int num_campos, Producto *producto) {
+    if (num_campos < 3) return 0;
 
-    char *token = strtok(copia_linea, ",");
-    if (!token) return 0;
-    safe_strcpy(producto->nombre, token, sizeof(producto->nombre));
+    csv_copiar(&campos[0], producto->nombre, sizeof(producto->nombre));
+    if (producto->nombre[0] == '\0') return 0;
 
-    token = strtok(NULL, ",");
-    if (!token) return 0;
-    producto->precio = strtod(token, NULL);
+    char precio[MAX_PRECIO_LENGTH];
+    if (csv_copiar(&campos[1], precio, sizeof(precio)) >= sizeof(precio)) return 0;
+    producto->precio = strtod(precio, NULL);
     if (producto->precio <= 0) return 0;
 
-    token = strtok(NULL, ",\n");
-    if (!token) return 0;
-    safe_strcpy(producto->sku, token, sizeof(producto->sku));
-    
+    // Un SKU que no cabe no puede ser válido; no se trunca
+    if (csv_copiar(&campos[2], producto->sku, sizeof(producto->sku)) >= sizeof(producto->sku)) return 0;
     return validar_sku(producto->sku);
 }
 
@@ -76,6 +85,78 @@ int insertar_producto_seguro(sqlite3 *db, const Producto *producto) {
     return rc == SQLITE_DONE;
 }
 
+// Carga masiva: una sola sentencia preparada y transacciones explícitas de
+// "lote" filas, de modo que hay un commit (y un fsync) por lote y no por fila
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *insert;
+    int lote;
+    int en_lote;
+} Cargador;
+
+int cargador_iniciar(Cargador *c, sqlite3 *db, int lote) {
+    // WAL con synchronous=NORMAL: sólo se sincroniza en los checkpoints y la
+    // base sigue siendo consistente si la carga se interrumpe
+    const char *pragmas =
+        "PRAGMA journal_mode=WAL;"
+        "PRAGMA synchronous=NORMAL;"
+        "PRAGMA temp_store=MEMORY;";
+    char sql_cache[64];
+    snprintf(sql_cache, sizeof(sql_cache), "PRAGMA cache_size=-%d;", CACHE_MASIVO_KB);
+
+    c->db = db;
+    c->lote = lote;
+    c->en_lote = 0;
+    if (sqlite3_exec(db, pragmas, NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_exec(db, sql_cache, NULL, NULL, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    return sqlite3_prepare_v2(db, "INSERT INTO productos(nombre, precio, sku) VALUES(?, ?, ?);",
+                              -1, &c->insert, NULL) == SQLITE_OK;
+}
+
+int cargador_insertar_campos(Cargador *c, const char *nombre, double precio, const char *sku) {
+    if (c->en_lote == 0 && sqlite3_exec(c->db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK) {
+        return 0;
+    }
+
+    sqlite3_bind_text(c->insert, 1, nombre, -1, SQLITE_STATIC);
+    sqlite3_bind_double(c->insert, 2, precio);
+    sqlite3_bind_text(c->insert, 3, sku, -1, SQLITE_STATIC);
+    // Un SKU duplicado sólo deshace esta fila, no la transacción del lote
+    int rc = sqlite3_step(c->insert);
+    sqlite3_reset(c->insert);
+
+    if (++c->en_lote == c->lote) {
+        c->en_lote = 0;
+        if (sqlite3_exec(c->db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) {
+            return 0;
+        }
+    }
+    return rc == SQLITE_DONE;
+}
+
+int cargador_insertar(Cargador *c, const Producto *producto) {
+    return cargador_insertar_campos(c, producto->nombre, producto->precio, producto->sku);
+}
+
+int cargador_cerrar(Cargador *c) {
+    int ok = 1;
+    if (c->en_lote > 0) {
+        ok = sqlite3_exec(c->db, "COMMIT;", NULL, NULL, NULL) == SQLITE_OK;
+        c->en_lote = 0;
+    }
+    sqlite3_finalize(c->insert);
+    c->insert = NULL;
+    return ok;
+}
+
+double segundos_desde(const struct timespec *inicio) {
+    struct timespec fin;
+    clock_gettime(CLOCK_MONOTONIC, &fin);
+    return (fin.tv_sec - inicio->tv_sec) + (fin.tv_nsec - inicio->tv_nsec) / 1e9;
+}
+
 FILE* abrir_archivo_seguro(const char *nombre_archivo) {
     int fd = open(nombre_archivo, O_RDONLY | O_NOFOLLOW);
     if (fd == -1) return NULL;
@@ -88,17 +169,12 @@ FILE* abrir_archivo_seguro(const char *nombre_archivo) {
     return archivo;
 }
 
-int procesar_csv(const char *nombre_archivo, const char *nombre_db) {
-    FILE *archivo = abrir_archivo_seguro(nombre_archivo);
-    if (!archivo) {
-        perror("Error al abrir el archivo CSV");
-        return 0;
-    }
-
+// Abre la base de datos y crea la tabla si no existe
+sqlite3 *abrir_db(const char *nombre_db) {
     sqlite3 *db;
     if (sqlite3_open_v2(nombre_db, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK) {
-        fclose(archivo);
-        return 0;
+        sqlite3_close(db);
+        return NULL;
     }
 
     const char *sql_crear_tabla = 
@@ -110,43 +186,363 @@ int procesar_csv(const char *nombre_archivo, const char *nombre_db) {
     
     if (sqlite3_exec(db, sql_crear_tabla, NULL, NULL, NULL) != SQLITE_OK) {
         sqlite3_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+// lote = 0: una transacción implícita por fila (modo original)
+int procesar_csv(const char *nombre_archivo, const char *nombre_db, int lote) {
+    FILE *archivo = abrir_archivo_seguro(nombre_archivo);
+    if (!archivo) {
+        perror("Error al abrir el archivo CSV");
+        return 0;
+    }
+
+    sqlite3 *db = abrir_db(nombre_db);
+    if (!db) {
         fclose(archivo);
         return 0;
     }
 
-    char linea[MAX_LINE_LENGTH + 1] = {0};
+    Cargador cargador = {0};
+    if (lote > 0 && !cargador_iniciar(&cargador, db, lote)) {
+        fprintf(stderr, "Error preparando la carga masiva: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        fclose(archivo);
+        return 0;
+    }
+
+    struct csv_lector lector;
+    struct csv_campo campos[MAX_CAMPOS];
+    int num_campos;
     int lineas_procesadas = 0;
     int productos_insertados = 0;
+    struct timespec inicio;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
 
     // Saltar cabecera
-    if (!fgets(linea, sizeof(linea), archivo)) {
+    if (!csv_lector_abrir(&lector, archivo) ||
+        csv_lector_siguiente(&lector, campos, MAX_CAMPOS, &num_campos) == CSV_FIN) {
+        csv_lector_cerrar(&lector);
+        if (lote > 0) cargador_cerrar(&cargador);
         sqlite3_close(db);
         fclose(archivo);
         return 0;
     }
 
-    while (fgets(linea, sizeof(linea), archivo)) {
+    int r;
+    while ((r = csv_lector_siguiente(&lector, campos, MAX_CAMPOS, &num_campos)) != CSV_FIN) {
         lineas_procesadas++;
-        linea[strcspn(linea, "\n")] = '\0';
 
         Producto producto = {0};
-        if (procesar_linea_csv(linea, &producto)) {
-            productos_insertados += insertar_producto_seguro(db, &producto);
+        if (r == CSV_REGISTRO && procesar_registro_csv(campos, num_campos, &producto)) {
+            productos_insertados += (lote > 0) ? cargador_insertar(&cargador, &producto)
+                                               : insertar_producto_seguro(db, &producto);
         }
     }
 
+    int ok = (lote == 0) || cargador_cerrar(&cargador);
+    double segundos = segundos_desde(&inicio);
+
     printf("Procesamiento completado. Líneas: %d, Productos insertados: %d\n", 
            lineas_procesadas, productos_insertados);
+    printf("Tiempo: %.2f s, %.0f filas/s\n", segundos, segundos > 0 ? lineas_procesadas / segundos : 0.0);
 
+    csv_lector_cerrar(&lector);
     fclose(archivo);
     sqlite3_close(db);
+    return ok;
+}
+
+// --- Carga en paralelo: lectores que analizan y un único escritor ---
+//
+// El CSV se proyecta en memoria y se divide en segmentos de unos SEGMENTO_BYTES
+// que terminan en un límite de registro (un salto de línea fuera de comillas).
+// Cada lector fija el final de su segmento al tomarlo, lo analiza y valida en
+// un lote por columnas y lo deja en la ranura (segmento % COLA_LOTES). El
+// escritor (el hilo principal) consume los segmentos en orden, así que ante SKUs
+// repetidos gana la misma fila que en la carga secuencial.
+
+typedef struct LoteColumnar {
+    int filas;
+    int capacidad;
+    int lineas;                       // Registros del segmento, válidos o no
+    double *precio;
+    size_t *nombre;                   // Desplazamientos en texto
+    size_t *sku;
+    char *texto;
+    size_t texto_len;
+    size_t texto_cap;
+    struct LoteColumnar *siguiente_libre;
+} LoteColumnar;
+
+typedef struct {
+    const char *datos;
+    size_t len;
+    size_t siguiente_inicio;          // Inicio del próximo segmento por asignar
+    int num_segmentos;                // INT_MAX hasta que se asigna el último
+    int siguiente_segmento;
+    int escritos;                     // Segmentos ya entregados al escritor
+    LoteColumnar *ranuras[COLA_LOTES];
+    LoteColumnar *libres;
+    pthread_mutex_t mutex;
+    pthread_cond_t hay_lote;
+    pthread_cond_t hay_hueco;
+} Pipeline;
+
+void lote_liberar(LoteColumnar *l) {
+    free(l->precio);
+    free(l->nombre);
+    free(l->sku);
+    free(l->texto);
+    free(l);
+}
+
+int lote_anadir(LoteColumnar *l, const Producto *producto) {
+    size_t len_nombre = strlen(producto->nombre) + 1;
+    size_t len_sku = strlen(producto->sku) + 1;
+
+    if (l->filas == l->capacidad) {
+        int cap = l->capacidad ? l->capacidad * 2 : 1024;
+        double *precio = realloc(l->precio, cap * sizeof(double));
+        if (precio) l->precio = precio;
+        size_t *nombre = realloc(l->nombre, cap * sizeof(size_t));
+        if (nombre) l->nombre = nombre;
+        size_t *sku = realloc(l->sku, cap * sizeof(size_t));
+        if (sku) l->sku = sku;
+        if (!precio || !nombre || !sku) return 0;
+        l->capacidad = cap;
+    }
+    if (l->texto_len + len_nombre + len_sku > l->texto_cap) {
+        size_t cap = l->texto_cap ? l->texto_cap : 64 * 1024;
+        while (cap < l->texto_len + len_nombre + len_sku) cap *= 2;
+        char *texto = realloc(l->texto, cap);
+        if (!texto) return 0;
+        l->texto = texto;
+        l->texto_cap = cap;
+    }
+
+    l->precio[l->filas] = producto->precio;
+    l->nombre[l->filas] = l->texto_len;
+    memcpy(l->texto + l->texto_len, producto->nombre, len_nombre);
+    l->texto_len += len_nombre;
+    l->sku[l->filas] = l->texto_len;
+    memcpy(l->texto + l->texto_len, producto->sku, len_sku);
+    l->texto_len += len_sku;
+    l->filas++;
+    return 1;
+}
+
+void analizar_segmento(const Pipeline *p, size_t pos, size_t fin, LoteColumnar *lote) {
+    struct csv_campo campos[MAX_CAMPOS];
+    int num_campos;
+    int r;
+
+    // El segmento acaba en un límite de registro: se analiza como un fichero completo
+    while ((r = csv_analizar(p->datos, fin, &pos, true, campos, MAX_CAMPOS, &num_campos)) != CSV_FIN) {
+        lote->lineas++;
+        Producto producto = {0};
+        if (r == CSV_REGISTRO && procesar_registro_csv(campos, num_campos, &producto)) {
+            lote_anadir(lote, &producto);
+        }
+    }
+}
+
+void *lector(void *arg) {
+    Pipeline *p = arg;
+    while (1) {
+        pthread_mutex_lock(&p->mutex);
+        if (p->siguiente_inicio >= p->len) {
+            p->num_segmentos = p->siguiente_segmento;
+            pthread_cond_broadcast(&p->hay_lote);
+            pthread_mutex_unlock(&p->mutex);
+            break;
+        }
+        int segmento = p->siguiente_segmento++;
+        size_t inicio = p->siguiente_inicio;
+        size_t fin = csv_limite_registro(p->datos, p->len, inicio, inicio + SEGMENTO_BYTES);
+        p->siguiente_inicio = fin;
+        LoteColumnar *lote = p->libres;
+        if (lote) p->libres = lote->siguiente_libre;
+        pthread_mutex_unlock(&p->mutex);
+
+        if (!lote) lote = calloc(1, sizeof(LoteColumnar));
+        lote->filas = 0;
+        lote->lineas = 0;
+        lote->texto_len = 0;
+        analizar_segmento(p, inicio, fin, lote);
+
+        // La ventana de COLA_LOTES segmentos limita la memoria en vuelo
+        pthread_mutex_lock(&p->mutex);
+        while (segmento >= p->escritos + COLA_LOTES) {
+            pthread_cond_wait(&p->hay_hueco, &p->mutex);
+        }
+        p->ranuras[segmento % COLA_LOTES] = lote;
+        pthread_cond_broadcast(&p->hay_lote);
+        pthread_mutex_unlock(&p->mutex);
+    }
+    return NULL;
+}
+
+// Carga con "hilos" lectores y un escritor en transacciones de "lote" filas
+int procesar_csv_paralelo(const char *nombre_archivo, const char *nombre_db, int lote, int hilos, int silencioso) {
+    int fd = open(nombre_archivo, O_RDONLY | O_NOFOLLOW);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror("Error al abrir el archivo CSV");
+        if (fd != -1) close(fd);
+        return 0;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    const char *datos = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (datos == MAP_FAILED) {
+        perror("Error al proyectar el archivo CSV");
+        return 0;
+    }
+    madvise((void *)datos, st.st_size, MADV_SEQUENTIAL);
+
+    sqlite3 *db = abrir_db(nombre_db);
+    Cargador cargador = {0};
+    if (!db || !cargador_iniciar(&cargador, db, lote)) {
+        fprintf(stderr, "Error preparando la carga masiva: %s\n", db ? sqlite3_errmsg(db) : nombre_db);
+        sqlite3_close(db);
+        munmap((void *)datos, st.st_size);
+        return 0;
+    }
+
+    // La cabecera puede tener campos entre comillas: se salta como un registro
+    Pipeline p = {.datos = datos, .len = (size_t)st.st_size, .num_segmentos = INT_MAX};
+    p.siguiente_inicio = csv_limite_registro(datos, p.len, 0, 1);
+    pthread_mutex_init(&p.mutex, NULL);
+    pthread_cond_init(&p.hay_lote, NULL);
+    pthread_cond_init(&p.hay_hueco, NULL);
+
+    struct timespec inicio;
+    clock_gettime(CLOCK_MONOTONIC, &inicio);
+
+    pthread_t lectores[MAX_LECTORES];
+    for (int i = 0; i < hilos; i++) {
+        pthread_create(&lectores[i], NULL, lector, &p);
+    }
+
+    int lineas_procesadas = 0;
+    int productos_insertados = 0;
+    for (int segmento = 0;; segmento++) {
+        pthread_mutex_lock(&p.mutex);
+        while (!p.ranuras[segmento % COLA_LOTES] && segmento < p.num_segmentos) {
+            pthread_cond_wait(&p.hay_lote, &p.mutex);
+        }
+        if (segmento >= p.num_segmentos) {
+            pthread_mutex_unlock(&p.mutex);
+            break;
+        }
+        LoteColumnar *l = p.ranuras[segmento % COLA_LOTES];
+        p.ranuras[segmento % COLA_LOTES] = NULL;
+        p.escritos = segmento + 1;
+        pthread_cond_broadcast(&p.hay_hueco);
+        pthread_mutex_unlock(&p.mutex);
+
+        lineas_procesadas += l->lineas;
+        for (int i = 0; i < l->filas; i++) {
+            productos_insertados += cargador_insertar_campos(&cargador, l->texto + l->nombre[i], l->precio[i],
+                                                             l->texto + l->sku[i]);
+        }
+
+        pthread_mutex_lock(&p.mutex);
+        l->siguiente_libre = p.libres;
+        p.libres = l;
+        pthread_mutex_unlock(&p.mutex);
+    }
+
+    for (int i = 0; i < hilos; i++) {
+        pthread_join(lectores[i], NULL);
+    }
+    int ok = cargador_cerrar(&cargador);
+    double segundos = segundos_desde(&inicio);
+
+    while (p.libres) {
+        LoteColumnar *l = p.libres;
+        p.libres = l->siguiente_libre;
+        lote_liberar(l);
+    }
+    pthread_mutex_destroy(&p.mutex);
+    pthread_cond_destroy(&p.hay_lote);
+    pthread_cond_destroy(&p.hay_hueco);
+    munmap((void *)datos, st.st_size);
+    sqlite3_close(db);
+
+    if (silencioso) {
+        printf("%d\t%.2f\t%.0f\n", hilos, segundos, segundos > 0 ? lineas_procesadas / segundos : 0.0);
+    } else {
+        printf("Procesamiento completado. Líneas: %d, Productos insertados: %d\n",
+               lineas_procesadas, productos_insertados);
+        printf("Tiempo: %.2f s, %.0f filas/s (%d lectores)\n", segundos,
+               segundos > 0 ? lineas_procesadas / segundos : 0.0, hilos);
+    }
+    return ok;
+}
+
+// Escalado del pipeline: carga el CSV en una base temporal nueva con 1..max lectores
+int bench_pipeline(const char *nombre_archivo, int max_hilos) {
+    char plantilla[] = "/tmp/bench_caso18_XXXXXX";
+    if (!mkdtemp(plantilla)) {
+        perror("mkdtemp");
+        return 0;
+    }
+
+    printf("lectores\tsegundos\tfilas/s\n");
+    for (int hilos = 1; hilos <= max_hilos; hilos *= 2) {
+        char nombre_db[sizeof(plantilla) + 32];
+        snprintf(nombre_db, sizeof(nombre_db), "%s/bench_%d.db", plantilla, hilos);
+        if (!procesar_csv_paralelo(nombre_archivo, nombre_db, LOTE_POR_DEFECTO, hilos, 1)) {
+            return 0;
+        }
+        const char *sufijos[] = {"", "-wal", "-shm"};
+        for (int i = 0; i < 3; i++) {
+            char ruta[sizeof(nombre_db) + 8];
+            snprintf(ruta, sizeof(ruta), "%s%s", nombre_db, sufijos[i]);
+            unlink(ruta);
+        }
+    }
+    rmdir(plantilla);
     return 1;
 }
 
 int main(int argc, char **argv) {
-    if (argc != 3) {
-        printf("Uso: %s <archivo_csv> <base_datos>\n", argv[0]);
+    if (argc == 4 && strcmp(argv[1], "--bench-pipeline") == 0) {
+        int max_hilos = atoi(argv[3]);
+        if (max_hilos < 1 || max_hilos > MAX_LECTORES) max_hilos = 8;
+        return bench_pipeline(argv[2], max_hilos) ? 0 : 1;
+    }
+
+    int lote = 0;
+    int hilos = 0;
+    int ok = argc >= 3;
+    for (int i = 3; ok && i < argc; i++) {
+        if (strcmp(argv[i], "--masivo") == 0) {
+            lote = LOTE_POR_DEFECTO;
+        } else if (strcmp(argv[i], "--lote") == 0 && i + 1 < argc) {
+            lote = atoi(argv[++i]);
+            ok = lote > 0;
+        } else if (strcmp(argv[i], "--hilos") == 0 && i + 1 < argc) {
+            hilos = atoi(argv[++i]);
+            ok = hilos > 0 && hilos <= MAX_LECTORES;
+        } else {
+            ok = 0;
+        }
+    }
+    if (!ok) {
+        printf("Uso: %s <archivo_csv> <base_datos> [--masivo | --lote <filas>] [--hilos <lectores>]\n"
+               "     %s --bench-pipeline <archivo_csv> <max_lectores>\n", argv[0], argv[0]);
         return 1;
     }
-    return procesar_csv(argv[1], argv[2]) ? 0 : 1;
-}
\ No newline at end of file
+    if (hilos > 0) {
+        return procesar_csv_paralelo(argv[1], argv[2], lote ? lote : LOTE_POR_DEFECTO, hilos, 0) ? 0 : 1;
+    }
+    return procesar_csv(argv[1], argv[2], lote) ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+#ifndef VALIDADOR_SKU_H
+#define VALIDADOR_SKU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Validador de SKUs compilado una sola vez a un autómata determinista (DFA).
+// Acepta el subconjunto de expresiones regulares extendidas que se usa para
+// describir SKUs: literales, '.', clases [..] con rangos y negación, escapes
+// con '\', cuantificadores ? * + {n} {n,} {n,m} y anclas ^ y $. No admite
+// alternativas, grupos ni las clases POSIX [:upper:], [=a=] o [.a.] dentro de
+// corchetes: compilar un patrón que las use devuelve false. Validar un SKU es
+// recorrer una tabla por byte, sin reservar memoria ni llamar a regexec.
+
+#define SKU_MAX_ELEMENTOS 63          // Posiciones del patrón ya expandido
+#define SKU_MAX_ESTADOS 128
+#define SKU_MAX_CLASES 32             // Clases de equivalencia de bytes
+
+struct sku_elemento {
+    uint8_t bytes[32];                // Conjunto de bytes que encajan
+    bool opcional;                    // Se puede saltar
+    bool repetible;                   // Puede encajar varias veces seguidas
+};
+
+struct validador_sku {
+    uint8_t clase_byte[256];
+    uint8_t transiciones[SKU_MAX_ESTADOS][SKU_MAX_CLASES];   // 0 = estado muerto
+    bool acepta[SKU_MAX_ESTADOS];
+    uint8_t inicial;
+    int num_estados;
+    int num_clases;
+};
+
+static inline void sku_marcar(uint8_t *bytes, unsigned int c) {
+    bytes[c >> 3] |= (uint8_t)(1u << (c & 7));
+}
+
+static inline bool sku_contiene(const uint8_t *bytes, unsigned int c) {
+    return bytes[c >> 3] & (1u << (c & 7));
+}
+
+// Lee un átomo (literal, '.', escape o clase) y avanza *p
+static inline bool sku_atomo(const char **p, uint8_t *bytes) {
+    const unsigned char *s = (const unsigned char *)*p;
+    memset(bytes, 0, 32);
+
+    if (*s == '.') {
+        memset(bytes, 0xFF, 32);
+        bytes[0] &= (uint8_t)~1u; // Nunca el terminador
+        s++;
+    } else if (*s == '\\' && s[1]) {
+        sku_marcar(bytes, s[1]);
+        s += 2;
+    } else if (*s == '[') {
+        s++;
+        bool negada = (*s == '^');
+        if (negada) s++;
+        bool primero = true;
+        while (*s && (*s != ']' || primero)) {
+            // [:clase:], [=equivalencia=] y [.símbolo.] no están soportados
+            if (*s == '[' && (s[1] == ':' || s[1] == '=' || s[1] == '.')) return false;
+            unsigned int desde = *s++;
+            unsigned int hasta = desde;
+            if (*s == '-' && s[1] && s[1] != ']') {
+                hasta = s[1];
+                s += 2;
+            }
+            if (hasta < desde) return false;
+            for (unsigned int c = desde; c <= hasta; c++) sku_marcar(bytes, c);
+            primero = false;
+        }
+        if (*s != ']') return false;
+        s++;
+        if (negada) {
+            for (int i = 0; i < 32; i++) bytes[i] = (uint8_t)~bytes[i];
+            bytes[0] &= (uint8_t)~1u;
+        }
+    } else if (*s && !strchr("*+?{}()|^$", *s)) {
+        sku_marcar(bytes, *s++);
+    } else {
+        return false;
+    }
+    *p = (const char *)s;
+    return true;
+}
+
+static inline bool sku_numero(const char **p, int *n) {
+    const char *s = *p;
+    if (*s < '0' || *s > '9') return false;
+    *n = 0;
+    while (*s >= '0' && *s <= '9' && *n <= SKU_MAX_ELEMENTOS) *n = *n * 10 + (*s++ - '0');
+    *p = s;
+    return true;
+}
+
+// Convierte el patrón en una secuencia de elementos repitiendo cada átomo
+// según su cuantificador: [A-Z]{3} son tres elementos obligatorios
+static inline int sku_expandir(const char *patron, struct sku_elemento *elem) {
+    int n = 0;
+    const char *p = patron;
+    bool inicio_anclado = (*p == '^');
+    if (inicio_anclado) p++;
+
+    // Sin anclas el patrón puede aparecer en cualquier posición, como en regexec
+    if (!inicio_anclado) {
+        memset(elem[n].bytes, 0xFF, 32);
+        elem[n].bytes[0] &= (uint8_t)~1u;
+        elem[n].opcional = elem[n].repetible = true;
+        n++;
+    }
+
+    bool fin_anclado = false;
+    while (*p) {
+        if (*p == '$' && p[1] == '\0') {
+            fin_anclado = true;
+            break;
+        }
+        uint8_t bytes[32];
+        if (!sku_atomo(&p, bytes)) return -1;
+
+        int min = 1, max = 1; // max < 0: sin límite
+        if (*p == '?') { min = 0; p++; }
+        else if (*p == '*') { min = 0; max = -1; p++; }
+        else if (*p == '+') { max = -1; p++; }
+        else if (*p == '{') {
+            p++;
+            if (!sku_numero(&p, &min)) return -1;
+            max = min;
+            if (*p == ',') {
+                p++;
+                max = -1;
+                if (*p != '}' && (!sku_numero(&p, &max) || max < min)) return -1;
+            }
+            if (*p++ != '}') return -1;
+        }
+
+        int copias = (max < 0) ? (min > 0 ? min : 1) : max;
+        if (n + copias > SKU_MAX_ELEMENTOS) return -1;
+        for (int i = 0; i < copias; i++) {
+            memcpy(elem[n].bytes, bytes, 32);
+            elem[n].opcional = (i >= min);
+            elem[n].repetible = (max < 0 && i == copias - 1);
+            n++;
+        }
+    }
+
+    if (!fin_anclado) {
+        if (n == SKU_MAX_ELEMENTOS) return -1;
+        memset(elem[n].bytes, 0xFF, 32);
+        elem[n].bytes[0] &= (uint8_t)~1u;
+        elem[n].opcional = elem[n].repetible = true;
+        n++;
+    }
+    return n;
+}
+
+// Estados del NFA alcanzables saltando elementos opcionales; el bit n es "fin"
+static inline uint64_t sku_cierre(const struct sku_elemento *elem, int n, uint64_t estados) {
+    for (int i = 0; i < n; i++) {
+        if ((estados >> i) & 1 && elem[i].opcional) estados |= 1ull << (i + 1);
+    }
+    return estados;
+}
+
+// Compila el patrón; false si usa algo fuera del subconjunto o es demasiado grande
+static inline bool validador_sku_compilar(struct validador_sku *v, const char *patron) {
+    struct sku_elemento elem[SKU_MAX_ELEMENTOS];
+    int n = sku_expandir(patron, elem);
+    if (n < 0) return false;
+    memset(v, 0, sizeof(*v));
+
+    // Bytes que ningún elemento distingue comparten columna en la tabla
+    int representante[SKU_MAX_CLASES];
+    for (unsigned int c = 0; c < 256; c++) {
+        int clase = -1;
+        for (int k = 0; k < v->num_clases && clase < 0; k++) {
+            bool igual = true;
+            for (int i = 0; i < n && igual; i++) {
+                igual = sku_contiene(elem[i].bytes, c) == sku_contiene(elem[i].bytes, (unsigned int)representante[k]);
+            }
+            if (igual) clase = k;
+        }
+        if (clase < 0) {
+            if (v->num_clases == SKU_MAX_CLASES) return false;
+            clase = v->num_clases++;
+            representante[clase] = (int)c;
+        }
+        v->clase_byte[c] = (uint8_t)clase;
+    }
+
+    // Construcción por subconjuntos; el estado 0 del DFA es el estado muerto
+    uint64_t conjuntos[SKU_MAX_ESTADOS];
+    conjuntos[0] = 0;
+    conjuntos[1] = sku_cierre(elem, n, 1);
+    v->num_estados = 2;
+    v->inicial = 1;
+    for (int e = 1; e < v->num_estados; e++) {
+        v->acepta[e] = (conjuntos[e] >> n) & 1;
+        for (int k = 0; k < v->num_clases; k++) {
+            unsigned int c = (unsigned int)representante[k];
+            uint64_t siguiente = 0;
+            for (int i = 0; i < n; i++) {
+                if ((conjuntos[e] >> i) & 1 && sku_contiene(elem[i].bytes, c)) {
+                    siguiente |= 1ull << (i + 1);
+                    if (elem[i].repetible) siguiente |= 1ull << i;
+                }
+            }
+            siguiente = sku_cierre(elem, n, siguiente);
+
+            int destino = 0;
+            for (int d = 0; d < v->num_estados && siguiente; d++) {
+                if (conjuntos[d] == siguiente) destino = d;
+            }
+            if (siguiente && !destino) {
+                if (v->num_estados == SKU_MAX_ESTADOS) return false;
+                destino = v->num_estados++;
+                conjuntos[destino] = siguiente;
+            }
+            v->transiciones[e][k] = (uint8_t)destino;
+        }
+    }
+    return true;
+}
+
+static inline bool validador_sku_valido(const struct validador_sku *v, const char *sku) {
+    unsigned int e = v->inicial;
+    for (const unsigned char *s = (const unsigned char *)sku; *s; s++) {
+        e = v->transiciones[e][v->clase_byte[*s]];
+        if (!e) return false;
+    }
+    return v->acepta[e];
+}
+
+#endif
@@ -3,41 +3,46 @@
 #include <string.h>
 #include <stdio.h>
 #include <arpa/inet.h>
+#include <signal.h>
+#include "ip_allowlist.h"
+#include "webhook_stream.h"
 
 #define PORT 8888
 #define MAX_POST_SIZE 65536
 #define SECRET_TOKEN "supersecreto123"  // Debe estar en entorno en producción
+#define ALLOWLIST_FILE "/etc/webhook_allowlist.conf" // Rangos CIDR autorizados, uno por línea
 
+// IPs autorizadas por defecto si no existe ALLOWLIST_FILE
 const char *allowed_ips[] = {
     "192.168.1.100",
     "10.0.0.5",
-    "203.0.113.42"
+    "203.0.113.42",
+    NULL
 };
-const size_t allowed_ips_count = sizeof(allowed_ips) / sizeof(allowed_ips[0]);
 
-int is_ip_allowed(const char *ip) {
-    for (size_t i = 0; i < allowed_ips_count; i++) {
-        if (strcmp(ip, allowed_ips[i]) == 0)
-            return 1;
-    }
-    return 0;
+int is_ip_allowed(const struct sockaddr *addr) {
+    return addr && allowlist_permitida(addr);
+}
+
+static void manejar_sighup(int sig) {
+    (void)sig;
+    allowlist_solicitar_recarga();
 }
 
+// Estado por conexión: vive en un bloque del pool del hilo de microhttpd
 struct connection_info_struct {
-    char *post_data;
-    size_t size;
+    struct buffer_cuerpo cuerpo;
+    struct json_extractor json;
 };
 
-static int iterate_post(void *coninfo_cls, enum MHD_ValueKind kind,
-                        const char *key, const char *filename,
-                        const char *content_type, const char *transfer_encoding,
-                        const char *data, uint64_t off, size_t size) {
-    struct connection_info_struct *con_info = coninfo_cls;
-    if (size + con_info->size >= MAX_POST_SIZE)
-        return MHD_NO;
-    memcpy(con_info->post_data + con_info->size, data, size);
-    con_info->size += size;
-    return MHD_YES;
+static void request_completed(void *cls, struct MHD_Connection *connection,
+                              void **con_cls, enum MHD_RequestTerminationCode toe) {
+    struct connection_info_struct *con_info = *con_cls;
+    if (!con_info)
+        return;
+    buffer_liberar(&con_info->cuerpo);
+    pool_devolver(con_info);
+    *con_cls = NULL;
 }
 
 static int request_handler(void *cls, struct MHD_Connection *connection,
@@ -45,14 +50,12 @@ static int request_handler(void *cls, struct MHD_Connection *connection,
                            const char *version, const char *upload_data,
                            size_t *upload_data_size, void **con_cls) {
     if (*con_cls == NULL) {
-        struct connection_info_struct *con_info = calloc(1, sizeof(struct connection_info_struct));
+        _Static_assert(sizeof(struct connection_info_struct) <= POOL_BLOQUE, "estado mayor que un bloque");
+        struct connection_info_struct *con_info = pool_obtener();
         if (!con_info)
             return MHD_NO;
-        con_info->post_data = calloc(1, MAX_POST_SIZE);
-        if (!con_info->post_data) {
-            free(con_info);
-            return MHD_NO;
-        }
+        memset(&con_info->cuerpo, 0, sizeof(con_info->cuerpo));
+        json_extractor_init(&con_info->json);
         *con_cls = con_info;
         return MHD_YES;
     }
@@ -62,23 +65,17 @@ static int request_handler(void *cls, struct MHD_Connection *connection,
     if (strcmp(method, "POST") != 0)
         return MHD_NO;
 
+    // El cuerpo se acumula bajo demanda y se tokeniza según llega
     if (*upload_data_size != 0) {
-        if (con_info->size + *upload_data_size >= MAX_POST_SIZE) return MHD_NO;
-        memcpy(con_info->post_data + con_info->size, upload_data, *upload_data_size);
-        con_info->size += *upload_data_size;
+        if (!buffer_anadir(&con_info->cuerpo, upload_data, *upload_data_size, MAX_POST_SIZE - 1)) return MHD_NO;
+        json_extractor_procesar(&con_info->json, upload_data, *upload_data_size);
         *upload_data_size = 0;
         return MHD_YES;
     }
 
-    // Validación de IP
+    // Validación de IP sobre la dirección binaria
     const union MHD_ConnectionInfo *info = MHD_get_connection_info(connection, MHD_CONNECTION_INFO_CLIENT_ADDRESS);
-    struct sockaddr_in *addr = (struct sockaddr_in *)info->client_addr;
-    char client_ip[INET_ADDRSTRLEN];
-    if (!inet_ntop(AF_INET, &(addr->sin_addr), client_ip, sizeof(client_ip))) {
-        return MHD_NO;
-    }
-
-    if (!is_ip_allowed(client_ip)) {
+    if (!info || !is_ip_allowed(info->client_addr)) {
         const char *forbidden = "403 Forbidden - IP";
         struct MHD_Response *response = MHD_create_response_from_buffer(strlen(forbidden), (void *)forbidden, MHD_RESPMEM_PERSISTENT);
         int ret = MHD_queue_response(connection, MHD_HTTP_FORBIDDEN, response);
@@ -97,7 +94,7 @@ static int request_handler(void *cls, struct MHD_Connection *connection,
     }
 
     // Validación básica del payload
-    if (con_info->size == 0 || con_info->size >= MAX_POST_SIZE) {
+    if (con_info->cuerpo.len == 0 || !json_extractor_fin(&con_info->json)) {
         const char *bad = "400 Bad Request";
         struct MHD_Response *response = MHD_create_response_from_buffer(strlen(bad), (void *)bad, MHD_RESPMEM_PERSISTENT);
         int ret = MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, response);
@@ -105,9 +102,15 @@ static int request_handler(void *cls, struct MHD_Connection *connection,
         return ret;
     }
 
+    char client_ip[INET_ADDRSTRLEN] = "?";
+    inet_ntop(AF_INET, &((struct sockaddr_in *)info->client_addr)->sin_addr, client_ip, sizeof(client_ip));
     printf("✅ IP válida: %s\n", client_ip);
     printf("✅ Token verificado\n");
-    printf("📦 Payload: %.*s\n", (int)con_info->size, con_info->post_data);
+    printf("📦 Payload: %.*s\n", (int)con_info->cuerpo.len, con_info->cuerpo.datos);
+    const char *id = json_campo(&con_info->json, JSON_CAMPO_ID);
+    const char *amount = json_campo(&con_info->json, JSON_CAMPO_AMOUNT);
+    const char *currency = json_campo(&con_info->json, JSON_CAMPO_CURRENCY);
+    printf("💳 Pago %s: %s %s\n", id ? id : "?", amount ? amount : "?", currency ? currency : "?");
 
     const char *ok = "200 OK";
     struct MHD_Response *response = MHD_create_response_from_buffer(strlen(ok), (void *)ok, MHD_RESPMEM_PERSISTENT);
@@ -116,11 +119,28 @@ static int request_handler(void *cls, struct MHD_Connection *connection,
     return ret;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    const char *allowlist_file = ALLOWLIST_FILE;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--allowlist") == 0 && i + 1 < argc) {
+            allowlist_file = argv[++i];
+        } else {
+            fprintf(stderr, "Uso: %s [--allowlist <fichero de rangos CIDR>]\n", argv[0]);
+            return 1;
+        }
+    }
+
     printf("⚠️  Este webhook DEBE ejecutarse bajo HTTPS en producción.\n");
 
+    // Lista de IPs: recarga automática al cambiar el fichero o con SIGHUP
+    if (!allowlist_init(allowlist_file, allowed_ips)) {
+        fprintf(stderr, "Lista de IPs autorizadas no válida\n");
+        return 1;
+    }
+    signal(SIGHUP, manejar_sighup);
+
     struct MHD_Daemon *daemon = MHD_start_daemon(MHD_USE_SELECT_INTERNALLY, PORT, NULL, NULL,
-                                                  &request_handler, NULL, MHD_OPTION_NOTIFY_COMPLETED, NULL, NULL,
+                                                  &request_handler, NULL, MHD_OPTION_NOTIFY_COMPLETED, &request_completed, NULL,
                                                   MHD_OPTION_END);
     if (!daemon)
         return 1;
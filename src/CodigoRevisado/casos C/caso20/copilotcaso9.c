@@ -1,26 +1,107 @@
 #include <microhttpd.h>
 #include <openssl/hmac.h>
-#include <jansson.h>
+#include <openssl/crypto.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/stat.h>
+#include "webhook_stream.h"
 
 #define PORT 8888
 #define AUTHORIZED_HOST "payments.example.com"
-#define MAX_PAYLOAD_SIZE 1024
+#define MAX_PAYLOAD_SIZE 1048576 // El cuerpo no se guarda: la memoria por conexión es constante
 #define SECRET_KEY "supersecretkey"
+#define CONEXIONES_LIBRES 64     // Estados reciclados por hilo
+#define MAX_PEM_LEN (1024 * 1024)
 
-int validate_signature(const char *payload, const char *received_signature) {
+// Estado de una petición en curso: el HMAC y el tokenizador avanzan con cada
+// trozo del cuerpo que entrega microhttpd
+struct conexion_webhook {
+    HMAC_CTX *hmac;
+    struct json_extractor json;
+    size_t recibidos;
+    struct conexion_webhook *siguiente_libre;
+};
+
+// Los estados liberados conservan su HMAC_CTX ya inicializado con la clave
+static __thread struct conexion_webhook *conexiones_libres;
+static __thread int num_conexiones_libres;
+
+static struct conexion_webhook *conexion_obtener(void) {
+    struct conexion_webhook *c = conexiones_libres;
+    if (c) {
+        conexiones_libres = c->siguiente_libre;
+        num_conexiones_libres--;
+        HMAC_Init_ex(c->hmac, NULL, 0, NULL, NULL); // Reinicia con la misma clave
+    } else {
+        c = malloc(sizeof(*c));
+        if (!c) return NULL;
+        c->hmac = HMAC_CTX_new();
+        if (!c->hmac || !HMAC_Init_ex(c->hmac, SECRET_KEY, strlen(SECRET_KEY), EVP_sha256(), NULL)) {
+            HMAC_CTX_free(c->hmac);
+            free(c);
+            return NULL;
+        }
+    }
+    json_extractor_init(&c->json);
+    c->recibidos = 0;
+    return c;
+}
+
+static void conexion_devolver(struct conexion_webhook *c) {
+    if (num_conexiones_libres < CONEXIONES_LIBRES) {
+        c->siguiente_libre = conexiones_libres;
+        conexiones_libres = c;
+        num_conexiones_libres++;
+    } else {
+        HMAC_CTX_free(c->hmac);
+        free(c);
+    }
+}
+
+static int valor_hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Cierra el HMAC acumulado y lo compara en binario y en tiempo constante
+int validate_signature(struct conexion_webhook *c, const char *received_signature) {
     unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned char recibida[EVP_MAX_MD_SIZE];
     unsigned int hash_len;
 
-    HMAC(EVP_sha256(), SECRET_KEY, strlen(SECRET_KEY), (unsigned char *)payload, strlen(payload), hash, &hash_len);
-
-    char hex_hash[hash_len * 2 + 1];
+    if (!received_signature || !HMAC_Final(c->hmac, hash, &hash_len)) {
+        return 0;
+    }
+    if (strlen(received_signature) != hash_len * 2) {
+        return 0;
+    }
     for (unsigned int i = 0; i < hash_len; i++) {
-        snprintf(&hex_hash[i * 2], 3, "%02x", hash[i]);
+        int hi = valor_hex(received_signature[2 * i]);
+        int lo = valor_hex(received_signature[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return 0;
+        }
+        recibida[i] = (unsigned char)((hi << 4) | lo);
     }
+    return CRYPTO_memcmp(hash, recibida, hash_len) == 0;
+}
 
-    return strcmp(hex_hash, received_signature) == 0;
+static int responder(struct MHD_Connection *connection, unsigned int status) {
+    struct MHD_Response *response = MHD_create_response_from_buffer(0, (void *)"", MHD_RESPMEM_PERSISTENT);
+    int ret = MHD_queue_response(connection, status, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+static void request_completed(void *cls, struct MHD_Connection *connection,
+                              void **con_cls, enum MHD_RequestTerminationCode toe) {
+    if (*con_cls) {
+        conexion_devolver(*con_cls);
+        *con_cls = NULL;
+    }
 }
 
 int process_request(void *cls, struct MHD_Connection *connection,
@@ -32,51 +113,117 @@ int process_request(void *cls, struct MHD_Connection *connection,
 
     const char *host_header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Host");
     if (!host_header || strcmp(host_header, AUTHORIZED_HOST) != 0) {
-        return MHD_queue_response(connection, MHD_HTTP_FORBIDDEN, NULL);
+        return responder(connection, MHD_HTTP_FORBIDDEN);
     }
 
-    if (*upload_data_size > 0 && *upload_data_size <= MAX_PAYLOAD_SIZE) {
-        const char *signature = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "X-Signature");
-        if (!validate_signature(upload_data, signature)) {
-            return MHD_queue_response(connection, MHD_HTTP_UNAUTHORIZED, NULL);
+    if (*con_cls == NULL) {
+        // Un Content-Length excesivo se rechaza antes de recibir el cuerpo
+        const char *longitud = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Content-Length");
+        if (longitud && strtoull(longitud, NULL, 10) > MAX_PAYLOAD_SIZE) {
+            return responder(connection, MHD_HTTP_PAYLOAD_TOO_LARGE);
         }
+        *con_cls = conexion_obtener();
+        return *con_cls ? MHD_YES : MHD_NO;
+    }
+    struct conexion_webhook *c = *con_cls;
 
-        // Parsear el JSON en el cuerpo de la solicitud
-        json_error_t error;
-        json_t *json_data = json_loads(upload_data, 0, &error);
-        if (!json_data) {
-            return MHD_queue_response(connection, MHD_HTTP_BAD_REQUEST, NULL);
+    // Cada trozo alimenta a la vez el HMAC y el tokenizador JSON. En cuanto se
+    // supera el límite se responde 413: microhttpd deja de leer el cuerpo
+    if (*upload_data_size > 0) {
+        size_t n = *upload_data_size;
+        *upload_data_size = 0;
+        c->recibidos += n;
+        if (c->recibidos > MAX_PAYLOAD_SIZE) {
+            return responder(connection, MHD_HTTP_PAYLOAD_TOO_LARGE);
         }
+        HMAC_Update(c->hmac, (const unsigned char *)upload_data, n);
+        json_extractor_procesar(&c->json, upload_data, n);
+        return MHD_YES;
+    }
 
-        // Procesar datos del JSON (ejemplo)
-        const char *payment_status = json_string_value(json_object_get(json_data, "status"));
-        if (payment_status && strcmp(payment_status, "completed") == 0) {
-            printf("Pago completado exitosamente.\n");
-        } else {
-            printf("Estado del pago no válido.\n");
-        }
+    if (c->recibidos == 0) {
+        return responder(connection, MHD_HTTP_PAYLOAD_TOO_LARGE);
+    }
 
-        json_decref(json_data);
-        *upload_data_size = 0;
+    const char *signature = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "X-Signature");
+    if (!validate_signature(c, signature)) {
+        return responder(connection, MHD_HTTP_UNAUTHORIZED);
+    }
+
+    if (!json_extractor_fin(&c->json)) {
+        return responder(connection, MHD_HTTP_BAD_REQUEST);
+    }
+
+    // Procesar los campos extraídos del JSON
+    const char *payment_status = json_campo(&c->json, JSON_CAMPO_STATUS);
+    if (payment_status && strcmp(payment_status, "completed") == 0) {
+        const char *id = json_campo(&c->json, JSON_CAMPO_ID);
+        const char *amount = json_campo(&c->json, JSON_CAMPO_AMOUNT);
+        const char *currency = json_campo(&c->json, JSON_CAMPO_CURRENCY);
+        printf("Pago completado exitosamente: %s %s %s\n", id ? id : "?", amount ? amount : "?",
+               currency ? currency : "?");
     } else {
-        return MHD_queue_response(connection, MHD_HTTP_PAYLOAD_TOO_LARGE, NULL);
+        printf("Estado del pago no válido.\n");
     }
 
-    return MHD_queue_response(connection, MHD_HTTP_OK, NULL);
+    return responder(connection, MHD_HTTP_OK);
+}
+
+// Lee un fichero PEM completo; microhttpd necesita la clave y el certificado en memoria
+static char *leer_pem(const char *ruta) {
+    FILE *f = fopen(ruta, "r");
+    if (!f) {
+        perror(ruta);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fileno(f), &st) < 0 || st.st_size <= 0 || st.st_size > MAX_PEM_LEN) {
+        fprintf(stderr, "%s: tamaño no válido (máximo %d bytes)\n", ruta, MAX_PEM_LEN);
+        fclose(f);
+        return NULL;
+    }
+    size_t len = (size_t)st.st_size;
+    char *pem = malloc(len + 1);
+    size_t n = pem ? fread(pem, 1, len, f) : 0;
+    fclose(f);
+    if (n != len) {
+        fprintf(stderr, "%s: lectura incompleta\n", ruta);
+        free(pem);
+        return NULL;
+    }
+    pem[len] = '\0';
+    return pem;
 }
 
 int main() {
+    // Sin clave ni certificado MHD_USE_SSL no puede arrancar: se leen del directorio actual
+    char *key_pem = leer_pem("server.key");
+    char *cert_pem = leer_pem("server.crt");
+    if (!key_pem || !cert_pem) {
+        fprintf(stderr, "Error al leer server.key / server.crt\n");
+        free(key_pem);
+        free(cert_pem);
+        return 1;
+    }
+
     struct MHD_Daemon *daemon;
     daemon = MHD_start_daemon(MHD_USE_SELECT_INTERNALLY | MHD_USE_SSL, PORT, NULL, NULL,
-                              &process_request, NULL, MHD_OPTION_END);
+                              &process_request, NULL,
+                              MHD_OPTION_HTTPS_MEM_KEY, key_pem,
+                              MHD_OPTION_HTTPS_MEM_CERT, cert_pem,
+                              MHD_OPTION_NOTIFY_COMPLETED, &request_completed, NULL, MHD_OPTION_END);
     if (!daemon) {
         printf("Error al iniciar el servidor HTTPS.\n");
+        free(key_pem);
+        free(cert_pem);
         return 1;
     }
 
     printf("Webhook seguro corriendo en el puerto %d\n", PORT);
     getchar(); // Mantén el servidor corriendo
     MHD_stop_daemon(daemon);
+    free(key_pem);
+    free(cert_pem);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+#ifndef EPOCAS_H
+#define EPOCAS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+// Reclamación por épocas para las estructuras que se publican con un cambio
+// atómico de puntero (claves, lista de IPs). Cada hilo lector tiene su ranura
+// y anota en ella la época global mientras está dentro de una sección de
+// lectura; fuera de ella la ranura vale 0. Quien retira una versión avanza la
+// época y espera a que ninguna ranura siga en una época anterior: a partir de
+// ahí ningún lector puede conservar el puntero viejo y se libera sin plazos.
+
+#define EPOCA_MAX_LECTORES 256        // Hilos con ranura a la vez; el resto espera a que se libere una
+#define EPOCA_ESPERA_US 100           // Sondeo de quien espera a los lectores
+
+struct epoca_lector {
+    uint64_t epoca;                   // 0: fuera de sección de lectura
+    int ocupada;
+} __attribute__((aligned(64)));      // Una línea de caché por lector: sin compartición falsa
+
+static struct epoca_lector epoca_lectores[EPOCA_MAX_LECTORES];
+static int epoca_num_lectores;        // Ranuras usadas alguna vez (límite del recorrido)
+static uint64_t epoca_global = 1;
+static pthread_key_t epoca_clave;
+static pthread_once_t epoca_una_vez = PTHREAD_ONCE_INIT;
+static __thread struct epoca_lector *epoca_propia;
+static __thread int epoca_anidada;
+
+// Al terminar el hilo su ranura queda libre para otro
+static void epoca_soltar_ranura(void *arg) {
+    struct epoca_lector *r = arg;
+    __atomic_store_n(&r->epoca, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->ocupada, 0, __ATOMIC_RELEASE);
+}
+
+static void epoca_crear_clave(void) {
+    pthread_key_create(&epoca_clave, epoca_soltar_ranura);
+}
+
+static inline struct epoca_lector *epoca_registrar(void) {
+    pthread_once(&epoca_una_vez, epoca_crear_clave);
+    while (1) {
+        for (int i = 0; i < EPOCA_MAX_LECTORES; i++) {
+            int libre = 0;
+            if (__atomic_compare_exchange_n(&epoca_lectores[i].ocupada, &libre, 1, false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                int usadas = __atomic_load_n(&epoca_num_lectores, __ATOMIC_RELAXED);
+                while (usadas <= i && !__atomic_compare_exchange_n(&epoca_num_lectores, &usadas, i + 1, false,
+                                                                   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                }
+                pthread_setspecific(epoca_clave, &epoca_lectores[i]);
+                return epoca_propia = &epoca_lectores[i];
+            }
+        }
+        sched_yield();
+    }
+}
+
+// Inicio de una sección de lectura; admite anidamiento en el mismo hilo
+static inline void epoca_entrar(void) {
+    if (epoca_anidada++ > 0) return;
+    struct epoca_lector *r = epoca_propia ? epoca_propia : epoca_registrar();
+    __atomic_store_n(&r->epoca, __atomic_load_n(&epoca_global, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    // La época debe ser visible antes de leer el puntero publicado
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void epoca_salir(void) {
+    if (--epoca_anidada > 0) return;
+    __atomic_store_n(&epoca_propia->epoca, 0, __ATOMIC_RELEASE);
+}
+
+// Tras retirar un puntero publicado: vuelve cuando ningún lector puede seguir usándolo
+static inline void epoca_sincronizar(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint64_t epoca = __atomic_add_fetch(&epoca_global, 1, __ATOMIC_SEQ_CST);
+    int usadas = __atomic_load_n(&epoca_num_lectores, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < usadas; i++) {
+        while (1) {
+            uint64_t vista = __atomic_load_n(&epoca_lectores[i].epoca, __ATOMIC_ACQUIRE);
+            if (vista == 0 || vista >= epoca) break;
+            usleep(EPOCA_ESPERA_US);
+        }
+    }
+}
+
+#endif
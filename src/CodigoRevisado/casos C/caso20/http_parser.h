@@ -0,0 +1,302 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+
+// Parser incremental de peticiones HTTP/1.1 para los webhooks de caso20.
+// Trabaja sobre el buffer de recepción del llamador: se le vuelve a llamar con
+// el buffer completo cada vez que llegan bytes y continúa donde se quedó. Las
+// cabeceras y el cuerpo se devuelven como trozos (desplazamiento + longitud)
+// dentro de ese buffer, de modo que el llamador puede ampliarlo con realloc.
+// Los cuerpos chunked se compactan en el propio buffer, sin copia auxiliar.
+
+#define HTTP_MAX_CABECERAS 32
+#define HTTP_MAX_LINEA 8192
+
+enum http_resultado {
+    HTTP_INCOMPLETA = 0,
+    HTTP_LISTA = 1,
+    HTTP_INVALIDA = -1,
+    HTTP_DEMASIADO_GRANDE = -2
+};
+
+enum http_estado {
+    HTTP_LINEA_PETICION,
+    HTTP_CABECERAS,
+    HTTP_CUERPO,
+    HTTP_CHUNK_TAM,
+    HTTP_CHUNK_DATOS,
+    HTTP_CHUNK_CRLF,
+    HTTP_TRAILER,
+    HTTP_COMPLETA
+};
+
+struct http_slice {
+    size_t inicio;
+    size_t len;
+};
+
+struct http_cabecera {
+    struct http_slice nombre;
+    struct http_slice valor;
+};
+
+struct http_parser {
+    enum http_estado estado;
+    size_t pos;                   // Primer byte aún no consumido
+    size_t max_cuerpo;
+    struct http_slice metodo;
+    struct http_slice ruta;
+    struct http_slice version;
+    struct http_cabecera cabeceras[HTTP_MAX_CABECERAS];
+    int num_cabeceras;
+    int chunked;
+    int tiene_longitud;
+    size_t content_length;
+    size_t chunk_restante;
+    struct http_slice cuerpo;     // En chunked crece a medida que se compactan los trozos
+};
+
+static inline void http_parser_init(struct http_parser *p, size_t max_cuerpo) {
+    memset(p, 0, sizeof(*p));
+    p->estado = HTTP_LINEA_PETICION;
+    p->max_cuerpo = max_cuerpo;
+}
+
+// Busca el fin de la línea que empieza en p->pos; fin excluye el CR final
+static inline int http_linea(const struct http_parser *p, const char *buf, size_t len,
+                             size_t *fin, size_t *siguiente) {
+    const char *nl = memchr(buf + p->pos, '\n', len - p->pos);
+    if (!nl) {
+        return 0;
+    }
+    *siguiente = (size_t)(nl - buf) + 1;
+    *fin = (size_t)(nl - buf);
+    if (*fin > p->pos && buf[*fin - 1] == '\r') {
+        (*fin)--;
+    }
+    return 1;
+}
+
+static inline int http_slice_igual(const char *buf, struct http_slice s, const char *texto) {
+    size_t n = strlen(texto);
+    return s.len == n && strncasecmp(buf + s.inicio, texto, n) == 0;
+}
+
+static inline struct http_slice http_recortar(const char *buf, size_t inicio, size_t fin) {
+    while (inicio < fin && (buf[inicio] == ' ' || buf[inicio] == '\t')) inicio++;
+    while (fin > inicio && (buf[fin - 1] == ' ' || buf[fin - 1] == '\t')) fin--;
+    return (struct http_slice){inicio, fin - inicio};
+}
+
+static inline int http_linea_peticion(struct http_parser *p, const char *buf, size_t fin) {
+    const char *linea = buf + p->pos;
+    size_t largo = fin - p->pos;
+    const char *sp1 = memchr(linea, ' ', largo);
+    if (!sp1 || sp1 == linea) {
+        return 0;
+    }
+    const char *sp2 = memchr(sp1 + 1, ' ', (size_t)(linea + largo - sp1 - 1));
+    if (!sp2 || sp2 == sp1 + 1) {
+        return 0;
+    }
+    p->metodo = (struct http_slice){p->pos, (size_t)(sp1 - linea)};
+    p->ruta = (struct http_slice){(size_t)(sp1 + 1 - buf), (size_t)(sp2 - sp1 - 1)};
+    p->version = (struct http_slice){(size_t)(sp2 + 1 - buf), (size_t)(buf + fin - sp2 - 1)};
+    return p->version.len == 8 && strncmp(buf + p->version.inicio, "HTTP/1.", 7) == 0;
+}
+
+static inline int http_cabecera_linea(struct http_parser *p, const char *buf, size_t fin) {
+    const char *dos_puntos = memchr(buf + p->pos, ':', fin - p->pos);
+    if (!dos_puntos || dos_puntos == buf + p->pos || p->num_cabeceras == HTTP_MAX_CABECERAS) {
+        return 0;
+    }
+    size_t fin_nombre = (size_t)(dos_puntos - buf);
+    for (size_t i = p->pos; i < fin_nombre; i++) {
+        if (buf[i] == ' ' || buf[i] == '\t') {
+            return 0;
+        }
+    }
+
+    struct http_cabecera *c = &p->cabeceras[p->num_cabeceras++];
+    c->nombre = (struct http_slice){p->pos, fin_nombre - p->pos};
+    c->valor = http_recortar(buf, fin_nombre + 1, fin);
+
+    if (http_slice_igual(buf, c->nombre, "Content-Length")) {
+        if (p->tiene_longitud || c->valor.len == 0) {
+            return 0;
+        }
+        size_t n = 0;
+        for (size_t i = 0; i < c->valor.len; i++) {
+            char d = buf[c->valor.inicio + i];
+            if (d < '0' || d > '9') {
+                return 0;
+            }
+            // Satura por encima del máximo para responder 413 sin desbordar
+            n = (n > p->max_cuerpo) ? n : n * 10 + (size_t)(d - '0');
+        }
+        p->content_length = n;
+        p->tiene_longitud = 1;
+    } else if (http_slice_igual(buf, c->nombre, "Transfer-Encoding")) {
+        // Sólo se admite chunked como codificación final
+        size_t n = c->valor.len;
+        if (n < 7 || strncasecmp(buf + c->valor.inicio + n - 7, "chunked", 7) != 0) {
+            return 0;
+        }
+        p->chunked = 1;
+    }
+    return 1;
+}
+
+// Tamaño hexadecimal de un chunk, ignorando extensiones tras ';'
+static inline int http_chunk_tam(const char *buf, size_t inicio, size_t fin, size_t *tam) {
+    size_t n = 0;
+    size_t i = inicio;
+    for (; i < fin && buf[i] != ';' && buf[i] != ' ' && buf[i] != '\t'; i++) {
+        char d = buf[i];
+        int v;
+        if (d >= '0' && d <= '9') v = d - '0';
+        else if (d >= 'a' && d <= 'f') v = d - 'a' + 10;
+        else if (d >= 'A' && d <= 'F') v = d - 'A' + 10;
+        else return 0;
+        if (n >> (sizeof(size_t) * 8 - 4)) {
+            return 0;
+        }
+        n = (n << 4) | (size_t)v;
+    }
+    if (i == inicio) {
+        return 0;
+    }
+    *tam = n;
+    return 1;
+}
+
+// Avanza sobre buf[0..len); devuelve HTTP_LISTA cuando la petición está completa
+static inline int http_parser_execute(struct http_parser *p, char *buf, size_t len) {
+    size_t fin, siguiente;
+
+    while (1) {
+        switch (p->estado) {
+            case HTTP_LINEA_PETICION:
+                if (!http_linea(p, buf, len, &fin, &siguiente)) {
+                    return (len - p->pos > HTTP_MAX_LINEA) ? HTTP_INVALIDA : HTTP_INCOMPLETA;
+                }
+                if (fin > p->pos) {
+                    if (!http_linea_peticion(p, buf, fin)) {
+                        return HTTP_INVALIDA;
+                    }
+                    p->estado = HTTP_CABECERAS;
+                }
+                p->pos = siguiente; // Las líneas vacías previas se toleran
+                break;
+
+            case HTTP_CABECERAS:
+                if (!http_linea(p, buf, len, &fin, &siguiente)) {
+                    return (len - p->pos > HTTP_MAX_LINEA) ? HTTP_INVALIDA : HTTP_INCOMPLETA;
+                }
+                if (fin > p->pos) {
+                    if (!http_cabecera_linea(p, buf, fin)) {
+                        return HTTP_INVALIDA;
+                    }
+                    p->pos = siguiente;
+                    break;
+                }
+                p->pos = siguiente;
+                p->cuerpo = (struct http_slice){p->pos, 0};
+                if (p->chunked) {
+                    if (p->tiene_longitud) {
+                        return HTTP_INVALIDA; // Ambas cabeceras: posible request smuggling
+                    }
+                    p->estado = HTTP_CHUNK_TAM;
+                } else if (p->content_length > p->max_cuerpo) {
+                    return HTTP_DEMASIADO_GRANDE;
+                } else {
+                    p->estado = HTTP_CUERPO;
+                }
+                break;
+
+            case HTTP_CUERPO:
+                if (len - p->pos < p->content_length) {
+                    return HTTP_INCOMPLETA;
+                }
+                p->cuerpo.len = p->content_length;
+                p->pos += p->content_length;
+                p->estado = HTTP_COMPLETA;
+                break;
+
+            case HTTP_CHUNK_TAM: {
+                size_t tam;
+                if (!http_linea(p, buf, len, &fin, &siguiente)) {
+                    return (len - p->pos > HTTP_MAX_LINEA) ? HTTP_INVALIDA : HTTP_INCOMPLETA;
+                }
+                if (!http_chunk_tam(buf, p->pos, fin, &tam)) {
+                    return HTTP_INVALIDA;
+                }
+                if (tam > p->max_cuerpo - p->cuerpo.len) {
+                    return HTTP_DEMASIADO_GRANDE;
+                }
+                p->pos = siguiente;
+                p->chunk_restante = tam;
+                p->estado = (tam == 0) ? HTTP_TRAILER : HTTP_CHUNK_DATOS;
+                break;
+            }
+
+            case HTTP_CHUNK_DATOS: {
+                size_t n = len - p->pos;
+                if (n > p->chunk_restante) {
+                    n = p->chunk_restante;
+                }
+                // Compacta el trozo tras lo ya decodificado; el destino nunca supera al origen
+                memmove(buf + p->cuerpo.inicio + p->cuerpo.len, buf + p->pos, n);
+                p->cuerpo.len += n;
+                p->pos += n;
+                p->chunk_restante -= n;
+                if (p->chunk_restante > 0) {
+                    return HTTP_INCOMPLETA;
+                }
+                p->estado = HTTP_CHUNK_CRLF;
+                break;
+            }
+
+            case HTTP_CHUNK_CRLF:
+                if (!http_linea(p, buf, len, &fin, &siguiente)) {
+                    return (len - p->pos > 2) ? HTTP_INVALIDA : HTTP_INCOMPLETA;
+                }
+                if (fin != p->pos) {
+                    return HTTP_INVALIDA;
+                }
+                p->pos = siguiente;
+                p->estado = HTTP_CHUNK_TAM;
+                break;
+
+            case HTTP_TRAILER:
+                if (!http_linea(p, buf, len, &fin, &siguiente)) {
+                    return (len - p->pos > HTTP_MAX_LINEA) ? HTTP_INVALIDA : HTTP_INCOMPLETA;
+                }
+                if (fin == p->pos) {
+                    p->estado = HTTP_COMPLETA; // Línea vacía: fin de los trailers
+                }
+                p->pos = siguiente;
+                break;
+
+            case HTTP_COMPLETA:
+                return HTTP_LISTA;
+        }
+    }
+}
+
+// Valor de la cabecera nombre (sin distinguir mayúsculas) o NULL si no está
+static inline const char *http_buscar_cabecera(const struct http_parser *p, const char *buf,
+                                               const char *nombre, size_t *len) {
+    for (int i = 0; i < p->num_cabeceras; i++) {
+        if (http_slice_igual(buf, p->cabeceras[i].nombre, nombre)) {
+            *len = p->cabeceras[i].valor.len;
+            return buf + p->cabeceras[i].valor.inicio;
+        }
+    }
+    return NULL;
+}
+
+#endif
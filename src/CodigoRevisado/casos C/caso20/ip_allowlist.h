@@ -0,0 +1,378 @@
+#ifndef IP_ALLOWLIST_H
+#define IP_ALLOWLIST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "epocas.h"
+
+// Lista de rangos CIDR autorizados (IPv4 e IPv6) compartida por los webhooks de
+// caso20. Se guarda en un poptrie de paso 8 bits con expansión de prefijos: cada
+// nodo lleva un bitmap de 256 bits con los bytes que tienen hijo y los hijos se
+// guardan contiguos, así que el hijo del byte b es base + popcount(bits < b).
+// Cada byte de la dirección es un acceso a memoria y la búsqueda termina en el
+// primer nodo que cubre la dirección (4 niveles como máximo en IPv4, 16 en IPv6).
+// Los prefijos se acumulan con allowlist_anadir_texto y allowlist_compilar
+// construye el trie de una vez, ya con los hijos de cada nodo agrupados.
+// La lista se recarga en segundo plano y se publica con un cambio atómico de
+// puntero; la versión anterior se libera cuando ya no la lee nadie (epocas.h).
+
+#define ALLOWLIST_POLL_SEG 2          // Comprobación de cambios en el fichero
+#define ALLOWLIST_LINEA_MAX 128
+
+enum { ALLOWLIST_V4, ALLOWLIST_V6 };
+
+struct allowlist_nodo {
+    uint64_t hijos[4];                // Bit por byte: hay un hijo para ese valor
+    uint64_t cubierto[4];             // Bit por byte: algún prefijo cubre ese subárbol
+    uint32_t base;                    // Índice del primer hijo; el resto van a continuación
+    uint8_t antes[4];                 // Hijos en las palabras anteriores de hijos[]
+};
+
+struct allowlist_prefijo {
+    uint8_t familia;
+    uint8_t bits;
+    unsigned char addr[16];
+};
+
+struct ip_allowlist {
+    struct allowlist_nodo *nodos;
+    uint32_t num_nodos;
+    uint32_t cap_nodos;
+    uint32_t raiz[2];
+    bool todo[2];                     // Prefijo /0
+    int prefijos;
+    struct allowlist_prefijo *pendientes;  // Sólo hasta allowlist_compilar
+    int num_pendientes;
+    int cap_pendientes;
+};
+
+// Reserva n nodos contiguos y devuelve el índice del primero
+static inline bool allowlist_nuevos_nodos(struct ip_allowlist *l, uint32_t n, uint32_t *primero) {
+    if (l->num_nodos + n > l->cap_nodos) {
+        uint32_t cap = l->cap_nodos ? l->cap_nodos : 64;
+        while (cap < l->num_nodos + n) cap *= 2;
+        struct allowlist_nodo *nodos = realloc(l->nodos, cap * sizeof(*nodos));
+        if (!nodos) return false;
+        l->nodos = nodos;
+        l->cap_nodos = cap;
+    }
+    memset(&l->nodos[l->num_nodos], 0, n * sizeof(l->nodos[0]));
+    *primero = l->num_nodos;
+    l->num_nodos += n;
+    return true;
+}
+
+static inline struct ip_allowlist *allowlist_crear(void) {
+    return calloc(1, sizeof(struct ip_allowlist));
+}
+
+static inline void allowlist_liberar(struct ip_allowlist *l) {
+    if (!l) return;
+    free(l->nodos);
+    free(l->pendientes);
+    free(l);
+}
+
+static inline bool allowlist_insertar(struct ip_allowlist *l, int familia, const unsigned char *addr, int bits) {
+    l->prefijos++;
+    if (bits == 0) {
+        l->todo[familia] = true;
+        return true;
+    }
+    if (l->num_pendientes == l->cap_pendientes) {
+        int cap = l->cap_pendientes ? l->cap_pendientes * 2 : 64;
+        struct allowlist_prefijo *p = realloc(l->pendientes, (size_t)cap * sizeof(*p));
+        if (!p) return false;
+        l->pendientes = p;
+        l->cap_pendientes = cap;
+    }
+
+    // Los bits fuera del prefijo se ponen a cero para que la ordenación agrupe bien
+    struct allowlist_prefijo *p = &l->pendientes[l->num_pendientes++];
+    memset(p, 0, sizeof(*p));
+    p->familia = (uint8_t)familia;
+    p->bits = (uint8_t)bits;
+    memcpy(p->addr, addr, familia == ALLOWLIST_V4 ? 4 : 16);
+    for (int i = 0; i < 16; i++) {
+        int resto = bits - 8 * i;
+        if (resto <= 0) p->addr[i] = 0;
+        else if (resto < 8) p->addr[i] &= (unsigned char)(0xFF00u >> resto);
+    }
+    return true;
+}
+
+static inline int allowlist_comparar_prefijos(const void *a, const void *b) {
+    const struct allowlist_prefijo *x = a, *y = b;
+    if (x->familia != y->familia) return x->familia - y->familia;
+    int c = memcmp(x->addr, y->addr, sizeof(x->addr));
+    return c ? c : x->bits - y->bits;
+}
+
+static inline bool allowlist_bit(const uint64_t *mapa, unsigned int b) {
+    return (mapa[b >> 6] >> (b & 63)) & 1;
+}
+
+// Construye el nodo n a partir de los prefijos [desde, hasta), que comparten los
+// primeros `nivel` bytes y están ordenados por dirección
+static inline bool allowlist_construir(struct ip_allowlist *l, uint32_t n, int nivel, int desde, int hasta) {
+    const struct allowlist_prefijo *p = l->pendientes;
+    uint64_t cubierto[4] = {0}, hijos[4] = {0};
+
+    // Prefijos que terminan en este byte: se marcan todos los valores que cubren
+    for (int i = desde; i < hasta; i++) {
+        int resto = p[i].bits - 8 * nivel;
+        if (resto <= 0 || resto > 8) continue;
+        unsigned int bajo = p[i].addr[nivel];
+        unsigned int alto = bajo | (0xFFu >> resto);
+        for (unsigned int b = bajo; b <= alto; b++) cubierto[b >> 6] |= 1ull << (b & 63);
+    }
+    // Los que siguen necesitan hijo, salvo que otro prefijo más corto ya los cubra
+    for (int i = desde; i < hasta; i++) {
+        unsigned int b = p[i].addr[nivel];
+        if (p[i].bits > 8 * (nivel + 1) && !allowlist_bit(cubierto, b)) hijos[b >> 6] |= 1ull << (b & 63);
+    }
+
+    uint32_t num_hijos = 0, base = 0;
+    uint8_t antes[4];
+    for (int w = 0; w < 4; w++) {
+        antes[w] = (uint8_t)num_hijos;
+        num_hijos += (uint32_t)__builtin_popcountll(hijos[w]);
+    }
+    if (num_hijos && !allowlist_nuevos_nodos(l, num_hijos, &base)) return false;
+
+    struct allowlist_nodo *nodo = &l->nodos[n]; // Tras reservar: realloc puede mover l->nodos
+    memcpy(nodo->hijos, hijos, sizeof(hijos));
+    memcpy(nodo->cubierto, cubierto, sizeof(cubierto));
+    memcpy(nodo->antes, antes, sizeof(antes));
+    nodo->base = base;
+
+    // Cada hijo recibe el tramo de prefijos con su byte, en el mismo orden que el bitmap
+    uint32_t hijo = base;
+    for (int i = desde; i < hasta;) {
+        unsigned int b = p[i].addr[nivel];
+        int fin = i;
+        while (fin < hasta && p[fin].addr[nivel] == b) fin++;
+        // Los prefijos del tramo que ya terminaron aquí no marcan nada en el hijo
+        if (allowlist_bit(hijos, b) && !allowlist_construir(l, hijo++, nivel + 1, i, fin)) return false;
+        i = fin;
+    }
+    return true;
+}
+
+// Construye el trie con los prefijos añadidos; después la lista sólo admite búsquedas
+static inline bool allowlist_compilar(struct ip_allowlist *l) {
+    qsort(l->pendientes, (size_t)l->num_pendientes, sizeof(*l->pendientes), allowlist_comparar_prefijos);
+    int v6 = 0;
+    while (v6 < l->num_pendientes && l->pendientes[v6].familia == ALLOWLIST_V4) v6++;
+
+    uint32_t raices;
+    bool ok = allowlist_nuevos_nodos(l, 2, &raices);
+    if (ok) {
+        l->raiz[ALLOWLIST_V4] = raices;
+        l->raiz[ALLOWLIST_V6] = raices + 1;
+        ok = allowlist_construir(l, raices, 0, 0, v6) &&
+             allowlist_construir(l, raices + 1, 0, v6, l->num_pendientes);
+    }
+    free(l->pendientes);
+    l->pendientes = NULL;
+    l->num_pendientes = l->cap_pendientes = 0;
+    return ok;
+}
+
+static inline bool allowlist_contiene(const struct ip_allowlist *l, int familia, const unsigned char *addr) {
+    if (l->todo[familia]) return true;
+    if (!l->nodos) return false;
+
+    int bytes = (familia == ALLOWLIST_V4) ? 4 : 16;
+    const struct allowlist_nodo *nodo = &l->nodos[l->raiz[familia]];
+    for (int i = 0; i < bytes; i++) {
+        unsigned int b = addr[i];
+        uint64_t bit = 1ull << (b & 63);
+        if (nodo->cubierto[b >> 6] & bit) return true;
+        uint64_t palabra = nodo->hijos[b >> 6];
+        if (!(palabra & bit)) return false;
+        nodo = &l->nodos[nodo->base + nodo->antes[b >> 6] + (uint32_t)__builtin_popcountll(palabra & (bit - 1))];
+    }
+    return false;
+}
+
+// Añade una entrada "ip" o "ip/bits" en texto
+static inline bool allowlist_anadir_texto(struct ip_allowlist *l, const char *texto) {
+    char ip[ALLOWLIST_LINEA_MAX];
+    unsigned char addr[16];
+    snprintf(ip, sizeof(ip), "%s", texto);
+
+    int bits = -1;
+    char *barra = strchr(ip, '/');
+    if (barra) {
+        char *fin;
+        *barra = '\0';
+        long b = strtol(barra + 1, &fin, 10);
+        if (fin == barra + 1 || *fin != '\0' || b < 0 || b > 128) return false;
+        bits = (int)b;
+    }
+
+    if (inet_pton(AF_INET, ip, addr) == 1) {
+        if (bits > 32) return false;
+        return allowlist_insertar(l, ALLOWLIST_V4, addr, bits < 0 ? 32 : bits);
+    }
+    if (inet_pton(AF_INET6, ip, addr) == 1) {
+        // Las IPv4 mapeadas en IPv6 se buscan siempre como IPv4, así que se guardan
+        // como IPv4; un prefijo mapeado más corto que /96 no tiene equivalente
+        if (IN6_IS_ADDR_V4MAPPED((struct in6_addr *)addr)) {
+            if (bits >= 0 && bits < 96) return false;
+            return allowlist_insertar(l, ALLOWLIST_V4, addr + 12, bits < 0 ? 32 : bits - 96);
+        }
+        return allowlist_insertar(l, ALLOWLIST_V6, addr, bits < 0 ? 128 : bits);
+    }
+    return false;
+}
+
+// Carga un fichero con un CIDR por línea ('#' inicia comentario). NULL si hay errores
+static inline struct ip_allowlist *allowlist_cargar(const char *ruta) {
+    FILE *f = fopen(ruta, "r");
+    if (!f) return NULL;
+
+    struct ip_allowlist *l = allowlist_crear();
+    char linea[ALLOWLIST_LINEA_MAX];
+    int num = 0;
+    while (l && fgets(linea, sizeof(linea), f)) {
+        num++;
+        char *p = linea;
+        char *comentario = strchr(p, '#');
+        if (comentario) *comentario = '\0';
+        while (*p == ' ' || *p == '\t') p++;
+        char *fin = p + strlen(p);
+        while (fin > p && (fin[-1] == '\n' || fin[-1] == '\r' || fin[-1] == ' ' || fin[-1] == '\t')) fin--;
+        *fin = '\0';
+        if (*p == '\0') continue;
+
+        if (!allowlist_anadir_texto(l, p)) {
+            fprintf(stderr, "[allowlist] %s:%d: entrada no válida '%s'\n", ruta, num, p);
+            allowlist_liberar(l);
+            l = NULL;
+        }
+    }
+    fclose(f);
+    if (l && !allowlist_compilar(l)) {
+        allowlist_liberar(l);
+        l = NULL;
+    }
+    return l;
+}
+
+static inline bool allowlist_contiene_sockaddr(const struct ip_allowlist *l, const struct sockaddr *sa) {
+    if (sa->sa_family == AF_INET) {
+        return allowlist_contiene(l, ALLOWLIST_V4, (const unsigned char *)&((const struct sockaddr_in *)sa)->sin_addr);
+    }
+    if (sa->sa_family == AF_INET6) {
+        const unsigned char *addr = ((const struct sockaddr_in6 *)sa)->sin6_addr.s6_addr;
+        if (IN6_IS_ADDR_V4MAPPED((const struct in6_addr *)addr)) {
+            return allowlist_contiene(l, ALLOWLIST_V4, addr + 12);
+        }
+        return allowlist_contiene(l, ALLOWLIST_V6, addr);
+    }
+    return false;
+}
+
+// Lista publicada: los lectores hacen una carga atómica del puntero dentro de
+// una sección de lectura por épocas
+static struct ip_allowlist *allowlist_actual;
+static const char *allowlist_ruta;
+static struct timespec allowlist_mtime;
+static int allowlist_recarga_pedida;
+
+static inline bool allowlist_permitida(const struct sockaddr *sa) {
+    epoca_entrar();
+    const struct ip_allowlist *l = __atomic_load_n(&allowlist_actual, __ATOMIC_ACQUIRE);
+    bool permitida = l && allowlist_contiene_sockaddr(l, sa);
+    epoca_salir();
+    return permitida;
+}
+
+// Segura desde un manejador de señales (SIGHUP)
+static inline void allowlist_solicitar_recarga(void) {
+    __atomic_store_n(&allowlist_recarga_pedida, 1, __ATOMIC_RELAXED);
+}
+
+static inline void allowlist_publicar(struct ip_allowlist *nueva, struct ip_allowlist **anterior) {
+    *anterior = __atomic_exchange_n(&allowlist_actual, nueva, __ATOMIC_ACQ_REL);
+}
+
+static void *allowlist_vigilante(void *arg) {
+    (void)arg;
+    while (1) {
+        sleep(ALLOWLIST_POLL_SEG);
+
+        struct stat st;
+        bool pedida = __atomic_exchange_n(&allowlist_recarga_pedida, 0, __ATOMIC_RELAXED);
+        if (stat(allowlist_ruta, &st) < 0) continue;
+        bool cambiado = st.st_mtim.tv_sec != allowlist_mtime.tv_sec || st.st_mtim.tv_nsec != allowlist_mtime.tv_nsec;
+        if (!pedida && !cambiado) continue;
+        allowlist_mtime = st.st_mtim;
+
+        struct ip_allowlist *nueva = allowlist_cargar(allowlist_ruta);
+        if (!nueva) {
+            fprintf(stderr, "[allowlist] recarga fallida, se mantiene la lista anterior\n");
+            continue;
+        }
+        fprintf(stderr, "[allowlist] %d prefijos recargados de %s\n", nueva->prefijos, allowlist_ruta);
+        struct ip_allowlist *retirada;
+        allowlist_publicar(nueva, &retirada);
+        epoca_sincronizar(); // Espera a las búsquedas que aún puedan usar la lista anterior
+        allowlist_liberar(retirada);
+    }
+    return NULL;
+}
+
+// Carga la lista de ruta y vigila sus cambios; si el fichero no existe se usan
+// las IPs por defecto (terminadas en NULL) sin recarga
+static inline bool allowlist_init(const char *ruta, const char *const *por_defecto) {
+    struct ip_allowlist *l = NULL;
+    struct stat st;
+
+    if (ruta && stat(ruta, &st) == 0) {
+        l = allowlist_cargar(ruta);
+        if (!l) return false;
+        allowlist_ruta = ruta;
+        allowlist_mtime = st.st_mtim;
+        fprintf(stderr, "[allowlist] %d prefijos cargados de %s\n", l->prefijos, ruta);
+    } else {
+        l = allowlist_crear();
+        for (int i = 0; l && por_defecto && por_defecto[i]; i++) {
+            if (!allowlist_anadir_texto(l, por_defecto[i])) {
+                allowlist_liberar(l);
+                return false;
+            }
+        }
+        if (!l || !allowlist_compilar(l)) {
+            allowlist_liberar(l);
+            return false;
+        }
+    }
+
+    struct ip_allowlist *anterior;
+    allowlist_publicar(l, &anterior);
+    if (anterior) {
+        epoca_sincronizar();
+        allowlist_liberar(anterior);
+    }
+
+    if (allowlist_ruta) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, allowlist_vigilante, NULL) != 0) return false;
+        pthread_detach(tid);
+    }
+    return true;
+}
+
+#endif
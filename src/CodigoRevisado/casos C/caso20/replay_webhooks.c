@@ -0,0 +1,503 @@
+// Reproductor de capturas de webhooks para las tres implementaciones de caso20
+// (seekcaso9.c sockets, chatgptcaso9.c y copilotcaso9.c microhttpd).
+//
+//   replay_webhooks <captura> [--puerto P] [--conexiones N] [--repeticiones R]
+//                   [--tls] [--refirmar clave] [--esquema seek|chatgpt|copilot]
+//                   [--formato json|csv]
+//   replay_webhooks --generar <captura> <n> <seek|chatgpt|copilot> <clave>
+//
+// La captura es una secuencia de registros "@@ <estado esperado> <bytes>\n"
+// seguidos de la petición HTTP en crudo (cabeceras + cuerpo) y un '\n'. Cada
+// petición se envía por una conexión nueva y se compara el estado recibido con
+// el esperado. --refirmar vuelve a firmar con la clave dada las peticiones que
+// deben aceptarse, según el esquema del destino (--esquema, seek por defecto):
+// seek firma timestamp + cuerpo y además actualiza X-Timestamp, porque
+// seekcaso9 rechaza timestamps fuera de su ventana; copilot firma sólo el
+// cuerpo; chatgpt compara X-Signature con un token fijo, que es la propia clave.
+//
+// Las entregas válidas esperan 200, así que la IP del reproductor debe estar
+// autorizada: seekcaso9 y chatgptcaso9 sólo admiten sus IPs por defecto si no
+// existe /etc/webhook_allowlist.conf. Para reproducir desde la misma máquina:
+//
+//   echo 127.0.0.0/8 > /tmp/allowlist.conf
+//   ./seekcaso9 --allowlist /tmp/allowlist.conf --key-file <fichero con la clave>
+//   ./chatgptcaso9 --allowlist /tmp/allowlist.conf
+//
+// Sin ello, alrededor del 80% de la captura aparece como discrepancias (403).
+//
+// copilotcaso9 sólo habla HTTPS en el puerto 8888 y lee server.key/server.crt
+// del directorio en el que se arranca:
+//
+//   replay_webhooks <captura> --tls --puerto 8888 --refirmar <clave> --esquema copilot
+//
+// gcc replay_webhooks.c -o replay_webhooks -lssl -lcrypto -lpthread
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include "http_parser.h"
+
+#define MAX_CONEXIONES 512
+#define MAX_PETICION 65536
+#define RESPUESTA_MAX 8192
+#define REINTENTOS_409 20
+
+struct registro {
+    int esperado;
+    char *datos;
+    size_t len;
+};
+
+struct config {
+    const char *captura;
+    int puerto;
+    int conexiones;
+    int repeticiones;
+    bool tls;
+    const char *refirmar;
+    const char *esquema;
+    bool csv;
+};
+
+struct resultado {
+    double *latencias;
+    int n;
+    int validadas;        // 2xx esperado y recibido
+    int rechazos_ok;      // Rechazo esperado con el mismo estado
+    int discrepancias;    // Estado distinto del esperado
+    int errores;          // Sin respuesta HTTP
+};
+
+static struct config cfg = {.puerto = 8080, .conexiones = 16, .repeticiones = 1, .esquema = "seek"};
+static struct registro *registros;
+static int num_registros;
+static int siguiente;
+static SSL_CTX *ssl_ctx;
+static struct resultado resultados[MAX_CONEXIONES];
+static char buffers[MAX_CONEXIONES][MAX_PETICION];   // Peticiones refirmadas, uno por cliente
+
+static double ms_desde(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+static bool cargar_captura(const char *ruta) {
+    FILE *f = fopen(ruta, "rb");
+    if (!f) {
+        perror(ruta);
+        return false;
+    }
+    int cap = 0;
+    int esperado;
+    size_t bytes;
+    while (fscanf(f, "@@ %d %zu", &esperado, &bytes) == 2 && fgetc(f) == '\n') {
+        if (bytes > MAX_PETICION) {
+            fprintf(stderr, "Registro %d demasiado grande\n", num_registros + 1);
+            fclose(f);
+            return false;
+        }
+        if (num_registros == cap) {
+            cap = cap ? cap * 2 : 256;
+            registros = realloc(registros, (size_t)cap * sizeof(*registros));
+        }
+        struct registro *r = &registros[num_registros];
+        r->esperado = esperado;
+        r->len = bytes;
+        r->datos = malloc(bytes + 1);
+        if (fread(r->datos, 1, bytes, f) != bytes) {
+            fprintf(stderr, "Registro %d truncado\n", num_registros + 1);
+            fclose(f);
+            return false;
+        }
+        fgetc(f); // '\n' separador
+        num_registros++;
+    }
+    fclose(f);
+    return num_registros > 0;
+}
+
+static void hmac_hex(const char *clave, const char *a, size_t a_len, const char *b, size_t b_len, char *hex) {
+    static const char digitos[] = "0123456789abcdef";
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int len;
+    HMAC_CTX *ctx = HMAC_CTX_new();
+    HMAC_Init_ex(ctx, clave, (int)strlen(clave), EVP_sha256(), NULL);
+    HMAC_Update(ctx, (const unsigned char *)a, a_len);
+    HMAC_Update(ctx, (const unsigned char *)b, b_len);
+    HMAC_Final(ctx, digest, &len);
+    HMAC_CTX_free(ctx);
+    for (unsigned int i = 0; i < len; i++) {
+        hex[2 * i] = digitos[digest[i] >> 4];
+        hex[2 * i + 1] = digitos[digest[i] & 0x0f];
+    }
+    hex[2 * len] = '\0';
+}
+
+// Reconstruye la petición con la firma del esquema de destino (y, en seek, el
+// timestamp actual). Sólo se firma de nuevo si el registro debe aceptarse; los
+// que esperan un rechazo conservan su firma inválida.
+static size_t refirmar(const struct registro *r, char *salida, size_t cap) {
+    char copia[MAX_PETICION + 1];
+    struct http_parser http;
+    memcpy(copia, r->datos, r->len);
+    http_parser_init(&http, MAX_PETICION);
+    if (http_parser_execute(&http, copia, r->len) != HTTP_LISTA) {
+        memcpy(salida, r->datos, r->len);
+        return r->len;
+    }
+
+    char timestamp[32];
+    snprintf(timestamp, sizeof(timestamp), "%ld", (long)time(NULL));
+    const char *cuerpo = copia + http.cuerpo.inicio;
+    size_t firma_len = 0, ts_len;
+    const char *firma = http_buscar_cabecera(&http, copia, "X-Signature", &firma_len);
+    char nueva_firma[2 * EVP_MAX_MD_SIZE + 1];
+    if (r->esperado / 100 == 2) {
+        if (strcmp(cfg.esquema, "seek") == 0) {
+            hmac_hex(cfg.refirmar, timestamp, strlen(timestamp), cuerpo, http.cuerpo.len, nueva_firma);
+        } else if (strcmp(cfg.esquema, "copilot") == 0) {
+            hmac_hex(cfg.refirmar, "", 0, cuerpo, http.cuerpo.len, nueva_firma);
+        } else {
+            snprintf(nueva_firma, sizeof(nueva_firma), "%s", cfg.refirmar);
+        }
+        firma = nueva_firma;
+        firma_len = strlen(nueva_firma);
+    }
+
+    size_t n = (size_t)snprintf(salida, cap, "%.*s %.*s %.*s\r\n",
+                                (int)http.metodo.len, copia + http.metodo.inicio,
+                                (int)http.ruta.len, copia + http.ruta.inicio,
+                                (int)http.version.len, copia + http.version.inicio);
+    for (int i = 0; i < http.num_cabeceras && n < cap; i++) {
+        struct http_cabecera *c = &http.cabeceras[i];
+        const char *nombre = copia + c->nombre.inicio;
+        if (http_slice_igual(copia, c->nombre, "X-Timestamp") ||
+            http_slice_igual(copia, c->nombre, "X-Signature") ||
+            http_slice_igual(copia, c->nombre, "Content-Length") ||
+            http_slice_igual(copia, c->nombre, "Transfer-Encoding")) {
+            continue;
+        }
+        n += (size_t)snprintf(salida + n, cap - n, "%.*s: %.*s\r\n", (int)c->nombre.len, nombre,
+                              (int)c->valor.len, copia + c->valor.inicio);
+    }
+    if (firma && n < cap) {
+        n += (size_t)snprintf(salida + n, cap - n, "X-Signature: %.*s\r\n", (int)firma_len, firma);
+    }
+    if (http_buscar_cabecera(&http, copia, "X-Timestamp", &ts_len) && n < cap) {
+        n += (size_t)snprintf(salida + n, cap - n, "X-Timestamp: %s\r\n", timestamp);
+    }
+    if (n < cap) {
+        n += (size_t)snprintf(salida + n, cap - n, "Content-Length: %zu\r\n\r\n", http.cuerpo.len);
+    }
+    if (n + http.cuerpo.len > cap) {
+        return 0;
+    }
+    memcpy(salida + n, cuerpo, http.cuerpo.len);
+    return n + http.cuerpo.len;
+}
+
+static int conectar(void) {
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons((uint16_t)cfg.puerto)};
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Lee la respuesta hasta completar Content-Length o hasta que el servidor cierre
+static int leer_estado(int fd, SSL *ssl) {
+    char buf[RESPUESTA_MAX];
+    size_t total = 0;
+    long esperado = -1;
+    while (total < sizeof(buf) - 1) {
+        int n = ssl ? SSL_read(ssl, buf + total, (int)(sizeof(buf) - 1 - total))
+                    : (int)read(fd, buf + total, sizeof(buf) - 1 - total);
+        if (n <= 0) break;
+        total += (size_t)n;
+        buf[total] = '\0';
+
+        char *fin = strstr(buf, "\r\n\r\n");
+        if (fin && esperado < 0) {
+            char *cl = strstr(buf, "\r\nContent-Length:");
+            if (!cl) cl = strstr(buf, "\r\ncontent-length:");
+            esperado = (cl && cl < fin) ? (fin + 4 - buf) + atol(cl + 17) : -2;
+        }
+        if (esperado >= 0 && (long)total >= esperado) break;
+    }
+    buf[total] = '\0';
+    if (total < 12 || strncmp(buf, "HTTP/1.", 7) != 0) {
+        return -1;
+    }
+    return atoi(buf + 9);
+}
+
+static int enviar(const char *req, size_t len) {
+    int fd = conectar();
+    if (fd < 0) return -1;
+
+    int estado = -1;
+    if (cfg.tls) {
+        SSL *ssl = SSL_new(ssl_ctx);
+        SSL_set_fd(ssl, fd);
+        if (SSL_connect(ssl) == 1 && SSL_write(ssl, req, (int)len) == (int)len) {
+            estado = leer_estado(fd, ssl);
+        }
+        SSL_free(ssl);
+    } else if (write(fd, req, len) == (ssize_t)len) {
+        estado = leer_estado(fd, NULL);
+    }
+    close(fd);
+    return estado;
+}
+
+static void *cliente(void *arg) {
+    struct resultado *r = arg;
+    char *salida = buffers[r - resultados];
+    int total = num_registros * cfg.repeticiones;
+
+    while (1) {
+        int i = __atomic_fetch_add(&siguiente, 1, __ATOMIC_RELAXED);
+        if (i >= total) break;
+        const struct registro *reg = &registros[i % num_registros];
+
+        const char *req = reg->datos;
+        size_t len = reg->len;
+        if (cfg.refirmar) {
+            len = refirmar(reg, salida, MAX_PETICION);
+            req = salida;
+        }
+
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        int estado = enviar(req, len);
+        // 409: seekcaso9 aún está persistiendo el original del reenvío; se reintenta
+        // como haría el proveedor hasta que lo confirme o lo dé por nuevo
+        for (int intento = 0; estado == 409 && reg->esperado / 100 == 2 && intento < REINTENTOS_409; intento++) {
+            usleep(10000);
+            estado = enviar(req, len);
+        }
+        r->latencias[r->n++] = ms_desde(&t0);
+
+        if (estado < 0) r->errores++;
+        else if (estado != reg->esperado) r->discrepancias++;
+        else if (estado / 100 == 2) r->validadas++;
+        else r->rechazos_ok++;
+    }
+    return NULL;
+}
+
+static int comparar_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentil(const double *v, int n, int p) {
+    int idx = (int)((long)n * p / 100);
+    return v[idx < n ? idx : n - 1];
+}
+
+static void informar(struct resultado *res, double ms_total) {
+    int n = 0, validadas = 0, rechazos_ok = 0, discrepancias = 0, errores = 0;
+    for (int i = 0; i < cfg.conexiones; i++) {
+        n += res[i].n;
+        validadas += res[i].validadas;
+        rechazos_ok += res[i].rechazos_ok;
+        discrepancias += res[i].discrepancias;
+        errores += res[i].errores;
+    }
+    if (n == 0) return;
+
+    double *todas = malloc((size_t)n * sizeof(double));
+    for (int i = 0, k = 0; i < cfg.conexiones; i++) {
+        memcpy(todas + k, res[i].latencias, (size_t)res[i].n * sizeof(double));
+        k += res[i].n;
+    }
+    qsort(todas, (size_t)n, sizeof(double), comparar_double);
+
+    double rps = n * 1000.0 / ms_total;
+    double validadas_s = validadas * 1000.0 / ms_total;
+    if (cfg.csv) {
+        printf("captura,peticiones,conexiones,rps,validadas_s,p50_ms,p90_ms,p99_ms,max_ms,"
+               "validadas,rechazos_correctos,discrepancias,errores\n");
+        printf("%s,%d,%d,%.1f,%.1f,%.3f,%.3f,%.3f,%.3f,%d,%d,%d,%d\n", cfg.captura, n, cfg.conexiones,
+               rps, validadas_s, percentil(todas, n, 50), percentil(todas, n, 90), percentil(todas, n, 99),
+               todas[n - 1], validadas, rechazos_ok, discrepancias, errores);
+    } else {
+        printf("{\"captura\":\"%s\",\"peticiones\":%d,\"conexiones\":%d,\"rps\":%.1f,\"validadas_s\":%.1f,"
+               "\"latencia_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},"
+               "\"validadas\":%d,\"rechazos_correctos\":%d,\"discrepancias\":%d,\"errores\":%d}\n",
+               cfg.captura, n, cfg.conexiones, rps, validadas_s, percentil(todas, n, 50),
+               percentil(todas, n, 90), percentil(todas, n, 99), todas[n - 1],
+               validadas, rechazos_ok, discrepancias, errores);
+    }
+    free(todas);
+}
+
+static void escribir_registro(FILE *f, int esperado, const char *req, size_t len) {
+    fprintf(f, "@@ %d %zu\n", esperado, len);
+    fwrite(req, 1, len, f);
+    fputc('\n', f);
+}
+
+// Genera una captura sintética con la forma de tráfico de cada implementación:
+// 80% entregas válidas, 10% firma incorrecta, 5% sin cabeceras, 5% reenvíos
+static int generar(const char *ruta, int n, const char *esquema, const char *clave) {
+    FILE *f = fopen(ruta, "wb");
+    if (!f) {
+        perror(ruta);
+        return 1;
+    }
+    bool seek = strcmp(esquema, "seek") == 0;
+    bool copilot = strcmp(esquema, "copilot") == 0;
+    if (!seek && !copilot && strcmp(esquema, "chatgpt") != 0) {
+        fprintf(stderr, "Esquema desconocido: %s\n", esquema);
+        fclose(f);
+        return 1;
+    }
+
+    char ultima_valida[MAX_PETICION];
+    size_t ultima_len = 0;
+    unsigned int semilla = 42;
+    for (int i = 0; i < n; i++) {
+        char cuerpo[256], req[2048], firma[2 * EVP_MAX_MD_SIZE + 1], timestamp[32];
+        int tipo = (int)(rand_r(&semilla) % 100);
+        int cuerpo_len = snprintf(cuerpo, sizeof(cuerpo),
+                                  "{\"payment\":{\"id\":\"pay_%d\",\"amount\":%d,\"currency\":\"EUR\"},"
+                                  "\"status\":\"completed\"}", i, 100 + (int)(rand_r(&semilla) % 100000));
+        snprintf(timestamp, sizeof(timestamp), "%ld", (long)time(NULL));
+
+        if (tipo >= 95 && ultima_len > 0) {
+            // Reenvío idéntico: seekcaso9 lo confirma como duplicado (200), o 409 mientras
+            // el original se persiste y el reproductor reintenta
+            escribir_registro(f, 200, ultima_valida, ultima_len);
+            continue;
+        }
+
+        bool valida = tipo < 80;
+        bool sin_cabeceras = tipo >= 90;
+        if (seek) {
+            hmac_hex(clave, timestamp, strlen(timestamp), cuerpo, (size_t)cuerpo_len, firma);
+        } else if (copilot) {
+            hmac_hex(clave, "", 0, cuerpo, (size_t)cuerpo_len, firma);
+        } else {
+            snprintf(firma, sizeof(firma), "%s", clave);
+        }
+        if (!valida) firma[0] = firma[0] == '0' ? '1' : '0';
+
+        int len;
+        if (sin_cabeceras) {
+            len = snprintf(req, sizeof(req), "POST /webhook HTTP/1.1\r\nHost: localhost\r\n"
+                           "Content-Type: application/json\r\nContent-Length: %d\r\n\r\n%s", cuerpo_len, cuerpo);
+        } else {
+            len = snprintf(req, sizeof(req), "POST /webhook HTTP/1.1\r\nHost: %s\r\n"
+                           "Content-Type: application/json\r\nX-Signature: %s\r\n%s%s%s"
+                           "Content-Length: %d\r\n\r\n%s",
+                           copilot ? "payments.example.com" : "localhost", firma,
+                           seek ? "X-Timestamp: " : "", seek ? timestamp : "", seek ? "\r\n" : "",
+                           cuerpo_len, cuerpo);
+        }
+
+        int esperado = 200;
+        if (sin_cabeceras) esperado = seek ? 400 : 403;
+        else if (!valida) esperado = seek || copilot ? 401 : 403;
+        escribir_registro(f, esperado, req, (size_t)len);
+
+        if (valida && !sin_cabeceras) {
+            memcpy(ultima_valida, req, (size_t)len);
+            ultima_len = (size_t)len;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static void uso(const char *prog) {
+    fprintf(stderr,
+            "Uso: %s <captura> [--puerto P] [--conexiones N] [--repeticiones R] [--tls]\n"
+            "          [--refirmar clave] [--esquema seek|chatgpt|copilot] [--formato json|csv]\n"
+            "     %s --generar <captura> <n> <seek|chatgpt|copilot> <clave>\n", prog, prog);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 6 && strcmp(argv[1], "--generar") == 0) {
+        return generar(argv[2], atoi(argv[3]), argv[4], argv[5]);
+    }
+    if (argc < 2) {
+        uso(argv[0]);
+        return 1;
+    }
+
+    cfg.captura = argv[1];
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--tls") == 0) {
+            cfg.tls = true;
+        } else if (i + 1 >= argc) {
+            uso(argv[0]);
+            return 1;
+        } else if (strcmp(argv[i], "--puerto") == 0) {
+            cfg.puerto = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--conexiones") == 0) {
+            cfg.conexiones = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--repeticiones") == 0) {
+            cfg.repeticiones = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--refirmar") == 0) {
+            cfg.refirmar = argv[++i];
+        } else if (strcmp(argv[i], "--esquema") == 0) {
+            cfg.esquema = argv[++i];
+        } else if (strcmp(argv[i], "--formato") == 0) {
+            cfg.csv = strcmp(argv[++i], "csv") == 0;
+        } else {
+            uso(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.conexiones < 1 || cfg.conexiones > MAX_CONEXIONES || cfg.repeticiones < 1 ||
+        (strcmp(cfg.esquema, "seek") != 0 && strcmp(cfg.esquema, "chatgpt") != 0 &&
+         strcmp(cfg.esquema, "copilot") != 0)) {
+        uso(argv[0]);
+        return 1;
+    }
+    if (!cargar_captura(cfg.captura)) {
+        fprintf(stderr, "Captura vacía o no válida: %s\n", cfg.captura);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    ssl_ctx = SSL_CTX_new(TLS_client_method());
+
+    static pthread_t tids[MAX_CONEXIONES];
+    int total = num_registros * cfg.repeticiones;
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < cfg.conexiones; i++) {
+        resultados[i].latencias = calloc((size_t)total, sizeof(double));
+        pthread_create(&tids[i], NULL, cliente, &resultados[i]);
+    }
+    for (int i = 0; i < cfg.conexiones; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    informar(resultados, ms_desde(&t0));
+
+    for (int i = 0; i < cfg.conexiones; i++) {
+        free(resultados[i].latencias);
+    }
+    for (int i = 0; i < num_registros; i++) {
+        free(registros[i].datos);
+    }
+    free(registros);
+    SSL_CTX_free(ssl_ctx);
+    return 0;
+}
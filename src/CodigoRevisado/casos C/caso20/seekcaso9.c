@@ -1,22 +1,49 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <poll.h>
 #include <openssl/sha.h>
 #include <openssl/hmac.h>
 #include <time.h>
+#include <signal.h>
+#include "http_parser.h"
+#include "ip_allowlist.h"
 
 #define PORT 8080
-#define MAX_REQUEST_SIZE 4096
+#define MAX_REQUEST_SIZE 65536   // Tamaño máximo de petición (cabeceras + cuerpo)
+#define BUFFER_INICIAL 4096      // El buffer de cada conexión crece por duplicación
 #define MAX_AUTH_HEADER_SIZE 512
 #define MAX_TIMESTAMP_DIFF 300 // 5 minutos en segundos
 #define SECRET_KEY_FILE "/etc/webhook_secret.key" // Archivo externo para clave
+#define KEY_OVERLAP_SEG (2 * MAX_TIMESTAMP_DIFF) // Validez de la clave anterior tras una rotación
+#define KEY_AGRUPAR_MS 200       // Silencio de inotify antes de recargar (agrupa ráfagas de eventos)
+#define ALLOWLIST_FILE "/etc/webhook_allowlist.conf" // Rangos CIDR autorizados, uno por línea
+#define QUEUE_FILE "webhook_queue.log"      // Log durable de pagos pendientes
+#define GROUP_COMMIT_US 200      // Ventana de agrupación de escrituras por defecto
+#define WORKERS 8                // Hilos de validación y procesamiento por defecto
+#define COLA_PETICIONES 1024     // Peticiones completas esperando worker
+#define MAX_CONEXIONES 4096      // Conexiones abiertas simultáneas
+#define MAX_EVENTOS 256
+#define TIMEOUT_INACTIVIDAD 10   // Segundos sin recibir bytes antes de cerrar
+#define TIMEOUT_CABECERAS 10     // Segundos desde accept para completar las cabeceras
+#define TIMEOUT_PETICION 30      // Segundos desde accept para completar el cuerpo
+#define RUEDA_RANURAS 64         // Rueda de plazos de un segundo por ranura
+#define BENCH_MAX_CONCURRENCIA 512
 
-// Lista de IPs autorizadas (mejor cargarla desde archivo de configuración)
+// IPs autorizadas por defecto si no existe ALLOWLIST_FILE
 const char *authorized_ips[] = {
     "192.168.1.100",
     "10.0.0.5",
@@ -24,9 +51,12 @@ const char *authorized_ips[] = {
     NULL
 };
 
+static const char *secret_key_file = SECRET_KEY_FILE;
+static bool silencioso = false;
+
 // Función segura para leer la clave secreta
 bool read_secret_key(char *buffer, size_t buffer_size) {
-    FILE *file = fopen(SECRET_KEY_FILE, "r");
+    FILE *file = fopen(secret_key_file, "r");
     if (!file) return false;
     
     if (!fgets(buffer, buffer_size, file)) {
@@ -42,20 +72,352 @@ bool read_secret_key(char *buffer, size_t buffer_size) {
     return true;
 }
 
-// Función para verificar IP autorizada
-bool is_ip_authorized(const char *ip) {
-    if (!ip) return false;
-    
-    for (int i = 0; authorized_ips[i] != NULL; i++) {
-        if (strcmp(ip, authorized_ips[i]) == 0) {
-            return true;
+// Función para verificar IP autorizada sobre la dirección binaria
+bool is_ip_authorized(const struct sockaddr *addr) {
+    if (!addr) return false;
+    return allowlist_permitida(addr);
+}
+
+
+// Claves de firma en memoria bloqueada (sin swap ni volcados de core). El juego
+// activo (primaria + secundaria durante una rotación) se publica con un cambio
+// atómico de puntero; el anterior se libera tras un periodo de gracia, cuando
+// ninguna validación en curso puede seguir usándolo.
+struct clave_secreta {
+    unsigned char *datos;        // Página propia con mlock
+    size_t len;
+    size_t mapeado;
+    uint64_t version;            // Única por clave cargada; identifica el contexto HMAC por hilo
+};
+
+struct juego_claves {
+    struct clave_secreta *primaria;
+    struct clave_secreta *secundaria;
+    time_t secundaria_hasta;     // 0: secundaria explícita en el fichero, sin caducidad
+};
+
+static struct juego_claves *claves_actuales;
+static int claves_recarga_pedida;
+static uint64_t claves_version;
+
+static struct clave_secreta *clave_crear(const char *texto, size_t len) {
+    struct clave_secreta *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    long pagina = sysconf(_SC_PAGESIZE);
+    c->mapeado = (len + (size_t)pagina - 1) / (size_t)pagina * (size_t)pagina;
+    c->datos = mmap(NULL, c->mapeado, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (c->datos == MAP_FAILED) {
+        free(c);
+        return NULL;
+    }
+    if (mlock(c->datos, c->mapeado) < 0) {
+        perror("mlock clave"); // Sigue funcionando, pero la clave podría acabar en swap
+    }
+    madvise(c->datos, c->mapeado, MADV_DONTDUMP);
+    memcpy(c->datos, texto, len);
+    c->len = len;
+    c->version = __atomic_add_fetch(&claves_version, 1, __ATOMIC_RELAXED);
+    return c;
+}
+
+static void clave_liberar(struct clave_secreta *c) {
+    if (!c) return;
+    OPENSSL_cleanse(c->datos, c->mapeado);
+    munlock(c->datos, c->mapeado);
+    munmap(c->datos, c->mapeado);
+    free(c);
+}
+
+static void juego_liberar(struct juego_claves *j) {
+    if (!j) return;
+    clave_liberar(j->primaria);
+    clave_liberar(j->secundaria);
+    free(j);
+}
+
+static bool clave_igual(const struct clave_secreta *c, const char *texto, size_t len) {
+    return c && c->len == len && CRYPTO_memcmp(c->datos, texto, len) == 0;
+}
+
+// Lee el fichero de claves: línea 1 primaria, línea 2 (opcional) secundaria.
+// Si la primaria cambia y no hay secundaria explícita, la anterior se acepta
+// durante KEY_OVERLAP_SEG para las entregas firmadas antes de la rotación.
+static struct juego_claves *claves_cargar(const struct juego_claves *actual) {
+    char lineas[2][256] = {{0}};
+    size_t lens[2] = {0, 0};
+    FILE *file = fopen(secret_key_file, "r");
+    if (!file) return NULL;
+    for (int i = 0; i < 2 && fgets(lineas[i], sizeof(lineas[i]), file); i++) {
+        lens[i] = strcspn(lineas[i], "\r\n");
+    }
+    fclose(file);
+
+    struct juego_claves *j = NULL;
+    time_t ahora = time(NULL);
+    if (lens[0] == 0 || !(j = calloc(1, sizeof(*j))) || !(j->primaria = clave_crear(lineas[0], lens[0]))) {
+        goto fin;
+    }
+
+    const struct clave_secreta *anterior = NULL;
+    if (lens[1] > 0) {
+        j->secundaria = clave_crear(lineas[1], lens[1]);
+        if (!j->secundaria) goto fin;
+    } else if (actual && !clave_igual(actual->primaria, lineas[0], lens[0])) {
+        anterior = actual->primaria;
+        j->secundaria_hasta = ahora + KEY_OVERLAP_SEG;
+    } else if (actual && actual->secundaria && actual->secundaria_hasta > ahora) {
+        anterior = actual->secundaria; // Recarga sin cambios: se conserva la ventana en curso
+        j->secundaria_hasta = actual->secundaria_hasta;
+    }
+    if (anterior) {
+        j->secundaria = clave_crear((const char *)anterior->datos, anterior->len);
+        if (!j->secundaria) goto fin;
+    }
+
+    OPENSSL_cleanse(lineas, sizeof(lineas));
+    return j;
+
+fin:
+    OPENSSL_cleanse(lineas, sizeof(lineas));
+    juego_liberar(j);
+    return NULL;
+}
+
+// Los workers sólo la usan entre epoca_entrar y epoca_salir: fuera de la sección el
+// juego puede liberarse. El vigilante, que es quien lo cambia, no lo necesita.
+static const struct juego_claves *claves_activas(void) {
+    return __atomic_load_n(&claves_actuales, __ATOMIC_ACQUIRE);
+}
+
+static long ms_monotonicos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Recarga en segundo plano: inotify sobre el directorio (cubre el reemplazo por
+// rename), SIGHUP y el fin de la ventana de solapamiento. Los eventos de una
+// misma escritura (IN_CREATE + IN_CLOSE_WRITE, o varios de un mv) se agrupan en
+// una sola recarga tras KEY_AGRUPAR_MS sin eventos nuevos.
+static void *vigilante_claves(void *arg) {
+    (void)arg;
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s", secret_key_file);
+    char *barra = strrchr(dir, '/');
+    const char *nombre = barra ? secret_key_file + (barra - dir) + 1 : secret_key_file;
+    if (barra) *barra = '\0';
+
+    int in = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (in < 0 || inotify_add_watch(in, barra ? (barra == dir ? "/" : dir) : ".",
+                                    IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        perror("inotify"); // Queda la recarga por SIGHUP
+    }
+
+    long recargar_en = -1;       // Recarga pendiente de que cese la ráfaga de eventos
+    while (1) {
+        long ahora = ms_monotonicos();
+        long espera = 1000;
+        if (recargar_en >= 0 && recargar_en - ahora < espera) {
+            espera = recargar_en > ahora ? recargar_en - ahora : 0;
+        }
+
+        struct pollfd pfd = {.fd = in, .events = POLLIN};
+        int r = poll(&pfd, in >= 0 ? 1 : 0, (int)espera);
+        ahora = ms_monotonicos();
+
+        if (__atomic_exchange_n(&claves_recarga_pedida, 0, __ATOMIC_RELAXED)) {
+            recargar_en = ahora;
         }
+        if (r > 0) {
+            char eventos[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            ssize_t n;
+            while ((n = read(in, eventos, sizeof(eventos))) > 0) {
+                for (char *p = eventos; p < eventos + n;) {
+                    struct inotify_event *ev = (struct inotify_event *)p;
+                    if (ev->len > 0 && strcmp(ev->name, nombre) == 0) {
+                        recargar_en = ahora + KEY_AGRUPAR_MS;
+                    }
+                    p += sizeof(struct inotify_event) + ev->len;
+                }
+            }
+        }
+        const struct juego_claves *actual = claves_activas();
+        if (actual && actual->secundaria && actual->secundaria_hasta &&
+            actual->secundaria_hasta <= time(NULL) && recargar_en < 0) {
+            recargar_en = ahora; // Fin del solapamiento: se borra la clave anterior de memoria
+        }
+        if (recargar_en < 0 || recargar_en > ahora) continue;
+        recargar_en = -1;
+
+        struct juego_claves *nuevo = claves_cargar(actual);
+        if (!nuevo) {
+            fprintf(stderr, "[claves] recarga fallida, se mantienen las claves actuales\n");
+            continue;
+        }
+        struct juego_claves *retirado = __atomic_exchange_n(&claves_actuales, nuevo, __ATOMIC_ACQ_REL);
+        if (retirado) {
+            // Un worker desalojado en mitad de validate_hmac puede seguir con el
+            // juego anterior: se libera cuando todos han salido de su sección
+            epoca_sincronizar();
+            juego_liberar(retirado);
+        }
+        if (!silencioso) {
+            fprintf(stderr, "[claves] claves recargadas%s\n", nuevo->secundaria ? " (con secundaria)" : "");
+        }
+    }
+    return NULL;
+}
+
+static void claves_solicitar_recarga(void) {
+    __atomic_store_n(&claves_recarga_pedida, 1, __ATOMIC_RELAXED);
+}
+
+// Carga inicial y arranque del vigilante
+static bool claves_init(void) {
+    static bool vigilando = false;
+    struct juego_claves *j = claves_cargar(NULL);
+    if (!j) return false;
+    struct juego_claves *anterior = __atomic_exchange_n(&claves_actuales, j, __ATOMIC_ACQ_REL);
+    if (anterior) {
+        epoca_sincronizar();
+        juego_liberar(anterior);
+    }
+
+    if (!vigilando) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, vigilante_claves, NULL) != 0) return false;
+        pthread_detach(tid);
+        vigilando = true;
     }
-    return false;
+    return true;
+}
+
+// SIGHUP recarga la lista de IPs y las claves
+static void manejar_sighup(int sig) {
+    (void)sig;
+    allowlist_solicitar_recarga();
+    claves_solicitar_recarga();
+}
+
+// Contexto HMAC por hilo y por ranura (primaria/secundaria) ya inicializado con
+// la clave; sólo se recalcula el padding cuando cambia la versión de la clave
+struct hmac_hilo {
+    HMAC_CTX *ctx[2];
+    uint64_t version[2];
+};
+
+static pthread_key_t hmac_key;
+static pthread_once_t hmac_key_once = PTHREAD_ONCE_INIT;
+
+static void liberar_hmac_hilo(void *ptr) {
+    struct hmac_hilo *h = ptr;
+    HMAC_CTX_free(h->ctx[0]);
+    HMAC_CTX_free(h->ctx[1]);
+    free(h);
+}
+
+static void crear_hmac_key(void) {
+    pthread_key_create(&hmac_key, liberar_hmac_hilo);
+}
+
+static HMAC_CTX *hmac_del_hilo(int ranura, const struct clave_secreta *clave) {
+    pthread_once(&hmac_key_once, crear_hmac_key);
+    struct hmac_hilo *h = pthread_getspecific(hmac_key);
+    if (!h) {
+        h = calloc(1, sizeof(*h));
+        if (!h) return NULL;
+        h->ctx[0] = HMAC_CTX_new();
+        h->ctx[1] = HMAC_CTX_new();
+        if (!h->ctx[0] || !h->ctx[1]) {
+            liberar_hmac_hilo(h);
+            return NULL;
+        }
+        pthread_setspecific(hmac_key, h);
+    }
+
+    if (h->version[ranura] == clave->version) {
+        // Misma clave: reinicia desde los pads precalculados
+        return HMAC_Init_ex(h->ctx[ranura], NULL, 0, NULL, NULL) ? h->ctx[ranura] : NULL;
+    }
+    if (!HMAC_Init_ex(h->ctx[ranura], clave->datos, (int)clave->len, EVP_sha256(), NULL)) {
+        h->version[ranura] = 0;
+        return NULL;
+    }
+    h->version[ranura] = clave->version;
+    return h->ctx[ranura];
+}
+
+static bool firma_coincide(int ranura, const struct clave_secreta *clave, const char *timestamp,
+                           const char *payload, size_t payload_len, const unsigned char *received) {
+    HMAC_CTX *ctx = hmac_del_hilo(ranura, clave);
+    if (!ctx) return false;
+
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    unsigned int len;
+    if (!HMAC_Update(ctx, (const unsigned char *)timestamp, strlen(timestamp)) ||
+        !HMAC_Update(ctx, (const unsigned char *)payload, payload_len) ||
+        !HMAC_Final(ctx, digest, &len) || len != SHA256_DIGEST_LENGTH) {
+        return false;
+    }
+
+    // Comparación segura contra timing attacks
+    return CRYPTO_memcmp(digest, received, sizeof(digest)) == 0;
+}
+
+// Tabla de dígitos hexadecimales: valor + 1, 0 para caracteres no válidos
+static const unsigned char tabla_hex[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16
+};
+
+// Decodifica una firma hexadecimal de exactamente 2 * len dígitos. Se opera en
+// unsigned: un dígito inválido vale 0 en la tabla y no se desplaza un negativo
+static bool decodificar_firma(const char *hex, unsigned char *out, size_t len) {
+    if (strnlen(hex, len * 2 + 1) != len * 2) return false;
+    unsigned int malos = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned int hi = tabla_hex[(unsigned char)hex[2 * i]];
+        unsigned int lo = tabla_hex[(unsigned char)hex[2 * i + 1]];
+        malos |= (hi == 0) | (lo == 0);
+        out[i] = (unsigned char)(((hi - 1u) << 4) | ((lo - 1u) & 0x0Fu));
+    }
+    return malos == 0;
 }
 
 // Función segura para validar HMAC
-bool validate_hmac(const char *payload, const char *received_signature, const char *timestamp) {
+bool validate_hmac(const char *payload, size_t payload_len, const char *received_signature, const char *timestamp) {
+    if (!payload || !received_signature || !timestamp) return false;
+
+    // Validar timestamp (prevent replay attacks)
+    time_t now = time(NULL);
+    time_t req_time = atol(timestamp);
+    if (labs(now - req_time) > MAX_TIMESTAMP_DIFF) {
+        return false;
+    }
+
+    // La firma recibida se pasa a binario: se comparan 32 bytes en vez de 64 caracteres
+    unsigned char received[SHA256_DIGEST_LENGTH];
+    if (!decodificar_firma(received_signature, received, sizeof(received))) {
+        return false;
+    }
+
+    // Claves ya cargadas en memoria: sin E/S de fichero por petición
+    epoca_entrar();
+    const struct juego_claves *claves = claves_activas();
+    bool valida = claves &&
+                  (firma_coincide(0, claves->primaria, timestamp, payload, payload_len, received) ||
+                   // Durante una rotación también vale la clave secundaria
+                   (claves->secundaria &&
+                    (claves->secundaria_hasta == 0 || now < claves->secundaria_hasta) &&
+                    firma_coincide(1, claves->secundaria, timestamp, payload, payload_len, received)));
+    epoca_salir();
+    return valida;
+}
+
+// Validación original: contexto nuevo y clave por petición (referencia del benchmark)
+bool validate_hmac_sin_cache(const char *payload, const char *received_signature, const char *timestamp) {
     if (!payload || !received_signature || !timestamp) return false;
 
     char secret_key[256];
@@ -66,7 +428,7 @@ bool validate_hmac(const char *payload, const char *received_signature, const ch
     // Validar timestamp (prevent replay attacks)
     time_t now = time(NULL);
     time_t req_time = atol(timestamp);
-    if (abs(now - req_time) > MAX_TIMESTAMP_DIFF) {
+    if (labs(now - req_time) > MAX_TIMESTAMP_DIFF) {
         return false;
     }
 
@@ -92,53 +454,530 @@ bool validate_hmac(const char *payload, const char *received_signature, const ch
     HMAC_CTX_free(ctx);
 
     // Convertir a hexadecimal de forma segura
-    for (int i = 0; i < len && i*2 < sizeof(calculated_signature)-1; i++) {
+    size_t hex_len = (size_t)len * 2;
+    if (hex_len >= sizeof(calculated_signature)) return false;
+    for (size_t i = 0; i < len; i++) {
         snprintf(&calculated_signature[i*2], 3, "%02x", (unsigned int)digest[i]);
     }
-    calculated_signature[len*2] = '\0';
+    calculated_signature[hex_len] = '\0';
 
-    // Comparación segura contra timing attacks
-    return CRYPTO_memcmp(calculated_signature, received_signature, strlen(calculated_signature)) == 0;
+    // Comparación segura contra timing attacks (sin leer más allá de la firma recibida)
+    if (strnlen(received_signature, hex_len + 1) != hex_len) return false;
+    return CRYPTO_memcmp(calculated_signature, received_signature, hex_len) == 0;
 }
 
-// Función segura para extraer encabezado
-bool extract_header(const char *request, const char *header_name, char *output, size_t output_size) {
-    char *line = strstr(request, header_name);
-    if (!line) return false;
-    
-    line += strlen(header_name);
-    char *end = strchr(line, '\r');
-    if (!end) end = strchr(line, '\n');
-    if (!end) return false;
-    
-    size_t length = end - line;
-    if (length >= output_size) return false;
-    
-    strncpy(output, line, length);
+// Copia el valor de una cabecera ya parseada a un buffer acotado
+bool extract_header(const struct http_parser *http, const char *request, const char *header_name,
+                    char *output, size_t output_size) {
+    size_t length;
+    const char *value = http_buscar_cabecera(http, request, header_name, &length);
+    if (!value || length >= output_size) return false;
+
+    memcpy(output, value, length);
     output[length] = '\0';
     return true;
 }
 
-// Función segura para procesar solicitud
-void handle_webhook_request(int client_socket, const char *client_ip) {
-    char request[MAX_REQUEST_SIZE + 1] = {0}; // +1 para null terminator
-    char response[MAX_REQUEST_SIZE];
+// Lógica de negocio del pago (aquí iría la lógica real)
+void process_payment(const char *payment_data, const char *client_ip) {
+    (void)payment_data;
+    if (!silencioso) {
+        printf("Procesando pago válido de %s\n", client_ip);
+    }
+}
+
+// Cola durable de pagos: los workers añaden el payload validado a un log de
+// solo-anexado y responden en cuanto está persistido; un hilo consumidor lo lee
+// y ejecuta process_payment. Las escrituras de varios workers se agrupan en una
+// sola write + fdatasync (group commit).
+struct registro_cabecera {
+    uint32_t len;                 // Bytes de payload
+    uint32_t checksum;            // FNV-1a de ip + payload
+    char client_ip[INET_ADDRSTRLEN];
+};
+
+static struct {
+    int fd;
+    int offset_fd;                // Posición consumida, para reanudar tras un reinicio
+    bool fsync;                   // false: sólo write (se pierde si cae el sistema)
+    int grupo_us;                 // Espera para acumular más registros por grupo
+    bool parar;
+    bool escribiendo;
+    char *pendiente;              // Registros aún no escritos
+    size_t pendiente_len;
+    size_t pendiente_cap;
+    char *lote;                   // Buffer del grupo en escritura
+    size_t lote_cap;
+    uint64_t ultimo_seq;
+    uint64_t seq_persistido;
+    off_t fin_persistido;
+    off_t consumido;
+    uint64_t grupos;
+    uint64_t registros;
+    uint64_t ns_escritura;
+    pthread_t escritor;
+    pthread_t consumidor;
+    pthread_mutex_t lock;
+    pthread_cond_t hay_datos;
+    pthread_cond_t persistido;
+    pthread_cond_t consumible;
+} cola_pagos = {
+    .fd = -1,
+    .offset_fd = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .hay_datos = PTHREAD_COND_INITIALIZER,
+    .persistido = PTHREAD_COND_INITIALIZER,
+    .consumible = PTHREAD_COND_INITIALIZER
+};
+
+static uint32_t checksum_registro(const char *client_ip, const char *payload, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < INET_ADDRSTRLEN; i++) h = (h ^ (unsigned char)client_ip[i]) * 16777619u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)payload[i]) * 16777619u;
+    return h;
+}
+
+// La posición sólo cuenta como guardada cuando está en disco: si no, tras una
+// caída podría apuntar más allá de lo que realmente se procesó
+static bool guardar_consumido(off_t consumido) {
+    uint64_t valor = (uint64_t)consumido;
+    if (pwrite(cola_pagos.offset_fd, &valor, sizeof(valor), 0) != sizeof(valor)) {
+        perror("pwrite offset");
+        return false;
+    }
+    if (cola_pagos.fsync && fdatasync(cola_pagos.offset_fd) < 0) {
+        perror("fdatasync offset");
+        return false;
+    }
+    return true;
+}
+
+// Persiste las entradas de directorio del log y del offset recién creados
+static bool sincronizar_directorio(const char *ruta) {
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s", ruta);
+    char *barra = strrchr(dir, '/');
+    if (!barra) snprintf(dir, sizeof(dir), ".");
+    else if (barra == dir) dir[1] = '\0';
+    else *barra = '\0';
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        perror("open directorio cola");
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    if (!ok) perror("fsync directorio cola");
+    close(fd);
+    return ok;
+}
+
+// Recorre el log desde el principio y devuelve el final del último registro
+// íntegro. *alineado indica si `consumido` cae en el límite de un registro.
+static off_t recuperar_log(int fd, off_t consumido, bool *alineado) {
+    struct registro_cabecera cab;
+    off_t pos = 0;
+    char *payload = malloc(MAX_REQUEST_SIZE);
+    *alineado = consumido == 0;
+    if (!payload) return 0;
+
+    while (pread(fd, &cab, sizeof(cab), pos) == sizeof(cab) && cab.len <= MAX_REQUEST_SIZE &&
+           pread(fd, payload, cab.len, pos + (off_t)sizeof(cab)) == (ssize_t)cab.len &&
+           checksum_registro(cab.client_ip, payload, cab.len) == cab.checksum) {
+        pos += (off_t)(sizeof(cab) + cab.len);
+        if (pos == consumido) *alineado = true;
+    }
+    free(payload);
+    return pos;
+}
+
+static void *escritor_cola(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&cola_pagos.lock);
+    while (1) {
+        while (cola_pagos.pendiente_len == 0 && !cola_pagos.parar) {
+            pthread_cond_wait(&cola_pagos.hay_datos, &cola_pagos.lock);
+        }
+        if (cola_pagos.pendiente_len == 0) break;
+
+        if (cola_pagos.grupo_us > 0) {
+            pthread_mutex_unlock(&cola_pagos.lock);
+            usleep((useconds_t)cola_pagos.grupo_us);
+            pthread_mutex_lock(&cola_pagos.lock);
+        }
+
+        // Intercambio de buffers: los workers siguen anexando mientras se escribe
+        char *lote = cola_pagos.pendiente;
+        size_t lote_len = cola_pagos.pendiente_len;
+        size_t lote_cap = cola_pagos.pendiente_cap;
+        uint64_t seq = cola_pagos.ultimo_seq;
+        cola_pagos.pendiente = cola_pagos.lote;
+        cola_pagos.pendiente_cap = cola_pagos.lote_cap;
+        cola_pagos.pendiente_len = 0;
+        cola_pagos.escribiendo = true;
+        pthread_mutex_unlock(&cola_pagos.lock);
+
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        size_t escrito = 0;
+        while (escrito < lote_len) {
+            ssize_t n = write(cola_pagos.fd, lote + escrito, lote_len - escrito);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                perror("write cola");
+                exit(EXIT_FAILURE); // Sin durabilidad no se puede confirmar nada más
+            }
+            escrito += (size_t)n;
+        }
+        if (cola_pagos.fsync && fdatasync(cola_pagos.fd) < 0) {
+            perror("fdatasync cola");
+            exit(EXIT_FAILURE);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        pthread_mutex_lock(&cola_pagos.lock);
+        cola_pagos.lote = lote;
+        cola_pagos.lote_cap = lote_cap;
+        cola_pagos.escribiendo = false;
+        cola_pagos.seq_persistido = seq;
+        cola_pagos.fin_persistido += (off_t)lote_len;
+        cola_pagos.grupos++;
+        cola_pagos.ns_escritura += (uint64_t)((t1.tv_sec - t0.tv_sec) * 1000000000LL + (t1.tv_nsec - t0.tv_nsec));
+        pthread_cond_broadcast(&cola_pagos.persistido);
+        pthread_cond_signal(&cola_pagos.consumible);
+    }
+    pthread_mutex_unlock(&cola_pagos.lock);
+    return NULL;
+}
+
+static void *consumidor_cola(void *arg) {
+    (void)arg;
+    size_t cap = 0;
+    char *buf = NULL;
+
+    while (1) {
+        pthread_mutex_lock(&cola_pagos.lock);
+        while (cola_pagos.consumido == cola_pagos.fin_persistido && !cola_pagos.parar) {
+            // Log consumido por completo: se trunca para que no crezca sin límite.
+            // El offset 0 se persiste antes de truncar: una caída entre ambos pasos
+            // reprocesa el log (al menos una vez) en lugar de saltarse los pagos que
+            // se anexen después a partir de una posición antigua.
+            if (cola_pagos.consumido > 0 && !cola_pagos.escribiendo && guardar_consumido(0)) {
+                if (ftruncate(cola_pagos.fd, 0) == 0 &&
+                    (!cola_pagos.fsync || fdatasync(cola_pagos.fd) == 0)) {
+                    cola_pagos.consumido = cola_pagos.fin_persistido = 0;
+                } else {
+                    perror("ftruncate cola");
+                    exit(EXIT_FAILURE); // El log ya no coincide con el offset guardado
+                }
+            }
+            pthread_cond_wait(&cola_pagos.consumible, &cola_pagos.lock);
+        }
+        if (cola_pagos.consumido == cola_pagos.fin_persistido) {
+            pthread_mutex_unlock(&cola_pagos.lock);
+            break;
+        }
+        off_t desde = cola_pagos.consumido;
+        off_t hasta = cola_pagos.fin_persistido;
+        pthread_mutex_unlock(&cola_pagos.lock);
+
+        size_t len = (size_t)(hasta - desde);
+        if (len + 1 > cap) {
+            char *nuevo = realloc(buf, len + 1);
+            if (!nuevo) {
+                perror("consumidor");
+                usleep(1000);
+                continue;
+            }
+            buf = nuevo;
+            cap = len + 1;
+        }
+        if (pread(cola_pagos.fd, buf, len, desde) != (ssize_t)len) {
+            perror("pread cola");
+            usleep(1000);
+            continue;
+        }
+
+        size_t pos = 0;
+        while (pos < len) {
+            struct registro_cabecera cab;
+            if (len - pos < sizeof(cab)) break;
+            memcpy(&cab, buf + pos, sizeof(cab));
+            char *payload = buf + pos + sizeof(cab);
+            if (cab.len > len - pos - sizeof(cab) ||
+                checksum_registro(cab.client_ip, payload, cab.len) != cab.checksum) {
+                break;
+            }
+            char siguiente = payload[cab.len];
+            payload[cab.len] = '\0';
+            process_payment(payload, cab.client_ip);
+            payload[cab.len] = siguiente;
+            pos += sizeof(cab) + cab.len;
+        }
+        if (pos != len) {
+            // Lo leído ya estaba persistido: un registro roto es corrupción, no una
+            // escritura a medias. Se guarda lo procesado y el arranque recupera el log.
+            fprintf(stderr, "Registro corrupto en la cola en el byte %lld\n", (long long)(desde + (off_t)pos));
+            guardar_consumido(desde + (off_t)pos);
+            exit(EXIT_FAILURE);
+        }
+
+        // Entrega al menos una vez: si el proceso cae antes de guardar la posición, se reprocesa
+        pthread_mutex_lock(&cola_pagos.lock);
+        cola_pagos.consumido = hasta;
+        pthread_mutex_unlock(&cola_pagos.lock);
+        guardar_consumido(hasta);
+    }
+    free(buf);
+    return NULL;
+}
+
+static bool cola_pagos_init(const char *ruta, bool fsync, int grupo_us) {
+    char ruta_offset[512];
+    snprintf(ruta_offset, sizeof(ruta_offset), "%s.offset", ruta);
+
+    cola_pagos.fd = open(ruta, O_RDWR | O_CREAT | O_APPEND, 0600);
+    cola_pagos.offset_fd = open(ruta_offset, O_RDWR | O_CREAT, 0600);
+    if (cola_pagos.fd < 0 || cola_pagos.offset_fd < 0) {
+        perror("open cola");
+        return false;
+    }
+
+    cola_pagos.fsync = fsync;
+    if (fsync && !sincronizar_directorio(ruta)) {
+        return false;
+    }
+
+    // Un registro a medio escribir al caer el proceso se descarta. Un offset que
+    // no cae en el límite de un registro íntegro no es de este log: se reprocesa
+    // desde el principio antes que empezar a leer a mitad de un registro.
+    uint64_t consumido = 0;
+    if (pread(cola_pagos.offset_fd, &consumido, sizeof(consumido), 0) != sizeof(consumido) ||
+        consumido > (uint64_t)INT64_MAX) {
+        consumido = 0;
+    }
+    bool alineado;
+    off_t fin = recuperar_log(cola_pagos.fd, (off_t)consumido, &alineado);
+    if (ftruncate(cola_pagos.fd, fin) < 0 || (fsync && fdatasync(cola_pagos.fd) < 0)) {
+        perror("ftruncate cola");
+        return false;
+    }
+    if (!alineado) {
+        fprintf(stderr, "Offset de la cola (%llu) fuera de registro: se reprocesa desde el inicio\n",
+                (unsigned long long)consumido);
+        consumido = 0;
+    }
+
+    cola_pagos.grupo_us = grupo_us;
+    cola_pagos.parar = false;
+    cola_pagos.fin_persistido = fin;
+    cola_pagos.consumido = (off_t)consumido;
+    cola_pagos.ultimo_seq = cola_pagos.seq_persistido = 0;
+    cola_pagos.grupos = cola_pagos.registros = cola_pagos.ns_escritura = 0;
+
+    if (pthread_create(&cola_pagos.escritor, NULL, escritor_cola, NULL) != 0 ||
+        pthread_create(&cola_pagos.consumidor, NULL, consumidor_cola, NULL) != 0) {
+        perror("pthread_create cola");
+        return false;
+    }
+    return true;
+}
+
+// Anexa un pago y espera a que su grupo esté persistido
+static bool cola_pagos_encolar(const char *payload, size_t len, const char *client_ip) {
+    struct registro_cabecera cab = {.len = (uint32_t)len};
+    snprintf(cab.client_ip, sizeof(cab.client_ip), "%s", client_ip);
+    cab.checksum = checksum_registro(cab.client_ip, payload, len);
+    size_t total = sizeof(cab) + len;
+
+    pthread_mutex_lock(&cola_pagos.lock);
+    if (cola_pagos.pendiente_len + total > cola_pagos.pendiente_cap) {
+        size_t nueva = cola_pagos.pendiente_cap ? cola_pagos.pendiente_cap : 65536;
+        while (nueva < cola_pagos.pendiente_len + total) nueva *= 2;
+        char *buf = realloc(cola_pagos.pendiente, nueva);
+        if (!buf) {
+            pthread_mutex_unlock(&cola_pagos.lock);
+            return false;
+        }
+        cola_pagos.pendiente = buf;
+        cola_pagos.pendiente_cap = nueva;
+    }
+    memcpy(cola_pagos.pendiente + cola_pagos.pendiente_len, &cab, sizeof(cab));
+    memcpy(cola_pagos.pendiente + cola_pagos.pendiente_len + sizeof(cab), payload, len);
+    cola_pagos.pendiente_len += total;
+    cola_pagos.registros++;
+    uint64_t seq = ++cola_pagos.ultimo_seq;
+    pthread_cond_signal(&cola_pagos.hay_datos);
+
+    while (cola_pagos.seq_persistido < seq) {
+        pthread_cond_wait(&cola_pagos.persistido, &cola_pagos.lock);
+    }
+    pthread_mutex_unlock(&cola_pagos.lock);
+    return true;
+}
+
+// Vacía lo pendiente, espera a que el consumidor termine y cierra el log
+static void cola_pagos_cerrar(void) {
+    pthread_mutex_lock(&cola_pagos.lock);
+    cola_pagos.parar = true;
+    pthread_cond_signal(&cola_pagos.hay_datos);
+    pthread_mutex_unlock(&cola_pagos.lock);
+    pthread_join(cola_pagos.escritor, NULL);
+
+    pthread_mutex_lock(&cola_pagos.lock);
+    pthread_cond_signal(&cola_pagos.consumible);
+    pthread_mutex_unlock(&cola_pagos.lock);
+    pthread_join(cola_pagos.consumidor, NULL);
+
+    close(cola_pagos.fd);
+    close(cola_pagos.offset_fd);
+    free(cola_pagos.pendiente);
+    free(cola_pagos.lote);
+    cola_pagos.pendiente = cola_pagos.lote = NULL;
+    cola_pagos.pendiente_len = cola_pagos.pendiente_cap = cola_pagos.lote_cap = 0;
+}
+
+// Índice de entregas ya aceptadas para rechazar reenvíos dentro de la ventana
+// de MAX_TIMESTAMP_DIFF. La firma cubre el timestamp, así que un reenvío cae
+// siempre en el mismo cubo (timestamp / DEDUP_CUBO_SEG): la consulta toca una
+// sola tabla de direccionamiento abierto y la memoria es fija.
+// Una entrada nace pendiente y sólo se confirma cuando el pago está en la cola:
+// hasta entonces un reenvío no puede darse por aceptado.
+#define DEDUP_CUBO_SEG 60
+#define DEDUP_CUBOS ((2 * MAX_TIMESTAMP_DIFF) / DEDUP_CUBO_SEG + 2)
+#define DEDUP_SLOTS 65536            // Potencia de dos, por cubo
+#define DEDUP_MAX_OCUPACION (DEDUP_SLOTS * 3 / 4)
+#define DEDUP_VACIO 0
+#define DEDUP_BORRADO 1
+#define DEDUP_PENDIENTE_BIT 1ull         // Bit bajo de la clave guardada: aún sin persistir
+
+struct dedup_cubo {
+    pthread_mutex_t lock;
+    long epoca;                      // timestamp / DEDUP_CUBO_SEG al que pertenece el contenido
+    int ocupados;
+    uint64_t claves[DEDUP_SLOTS];
+};
+
+static struct dedup_cubo *dedup_cubos;
+static uint64_t dedup_entregas;
+static uint64_t dedup_duplicados;
+static uint64_t dedup_desbordes;
+
+enum dedup_resultado { DEDUP_NUEVA, DEDUP_DUPLICADA, DEDUP_PENDIENTE, DEDUP_LLENO };
+
+static bool dedup_init(void) {
+    dedup_cubos = calloc(DEDUP_CUBOS, sizeof(struct dedup_cubo));
+    if (!dedup_cubos) return false;
+    for (int i = 0; i < DEDUP_CUBOS; i++) {
+        pthread_mutex_init(&dedup_cubos[i].lock, NULL);
+        dedup_cubos[i].epoca = -1;
+    }
+    return true;
+}
+
+static void dedup_report(void) {
+    uint64_t entregas = __atomic_load_n(&dedup_entregas, __ATOMIC_RELAXED);
+    uint64_t duplicados = __atomic_load_n(&dedup_duplicados, __ATOMIC_RELAXED);
+    printf("[dedup] entregas %llu, duplicados %llu (%.2f%%), desbordes %llu, memoria %zu KB\n",
+           (unsigned long long)entregas, (unsigned long long)duplicados,
+           entregas ? 100.0 * duplicados / entregas : 0.0,
+           (unsigned long long)__atomic_load_n(&dedup_desbordes, __ATOMIC_RELAXED),
+           DEDUP_CUBOS * sizeof(struct dedup_cubo) / 1024);
+}
+
+// La firma es un HMAC: sus primeros 8 bytes ya están uniformemente distribuidos.
+// El bit bajo se reserva para DEDUP_PENDIENTE_BIT, así que la clave siempre es par.
+static uint64_t dedup_clave(const unsigned char *firma) {
+    uint64_t clave;
+    memcpy(&clave, firma, sizeof(clave));
+    clave &= ~DEDUP_PENDIENTE_BIT;
+    return clave > DEDUP_BORRADO ? clave : clave + 2;
+}
+
+static bool dedup_coincide(uint64_t guardada, uint64_t clave) {
+    return (guardada & ~DEDUP_PENDIENTE_BIT) == clave;
+}
+
+static struct dedup_cubo *dedup_cubo_de(long epoca) {
+    return &dedup_cubos[epoca % DEDUP_CUBOS];
+}
+
+// Registra la entrega como pendiente; DEDUP_DUPLICADA si la misma firma ya se
+// persistió, DEDUP_PENDIENTE si otra petición la está encolando todavía
+static enum dedup_resultado dedup_registrar(const unsigned char *firma, time_t timestamp) {
+    long epoca = (long)(timestamp / DEDUP_CUBO_SEG);
+    struct dedup_cubo *c = dedup_cubo_de(epoca);
+    uint64_t clave = dedup_clave(firma);
+    enum dedup_resultado resultado = DEDUP_NUEVA;
+    bool rotado = false;
+
+    pthread_mutex_lock(&c->lock);
+    if (c->epoca != epoca) {
+        // El cubo guardaba un minuto ya fuera de la ventana: se reutiliza
+        memset(c->claves, 0, sizeof(c->claves));
+        c->ocupados = 0;
+        c->epoca = epoca;
+        rotado = true;
+    }
+
+    size_t i = clave & (DEDUP_SLOTS - 1);
+    size_t libre = DEDUP_SLOTS;
+    while (c->claves[i] != DEDUP_VACIO) {
+        if (dedup_coincide(c->claves[i], clave)) {
+            resultado = (c->claves[i] & DEDUP_PENDIENTE_BIT) ? DEDUP_PENDIENTE : DEDUP_DUPLICADA;
+            break;
+        }
+        if (c->claves[i] == DEDUP_BORRADO && libre == DEDUP_SLOTS) libre = i;
+        i = (i + 1) & (DEDUP_SLOTS - 1);
+    }
+    if (resultado == DEDUP_NUEVA) {
+        if (libre == DEDUP_SLOTS && c->ocupados >= DEDUP_MAX_OCUPACION) {
+            resultado = DEDUP_LLENO;
+        } else if (libre != DEDUP_SLOTS) {
+            c->claves[libre] = clave | DEDUP_PENDIENTE_BIT;
+        } else {
+            c->claves[i] = clave | DEDUP_PENDIENTE_BIT;
+            c->ocupados++;
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    __atomic_add_fetch(&dedup_entregas, 1, __ATOMIC_RELAXED);
+    if (resultado == DEDUP_DUPLICADA || resultado == DEDUP_PENDIENTE) __atomic_add_fetch(&dedup_duplicados, 1, __ATOMIC_RELAXED);
+    if (resultado == DEDUP_LLENO) __atomic_add_fetch(&dedup_desbordes, 1, __ATOMIC_RELAXED);
+    if (rotado && !silencioso) dedup_report();
+    return resultado;
+}
+
+// Cierra un registro pendiente: confirmado si el pago quedó persistido; si no,
+// se borra para que el reintento del proveedor pase como entrega nueva
+static void dedup_resolver(const unsigned char *firma, time_t timestamp, bool persistido) {
+    long epoca = (long)(timestamp / DEDUP_CUBO_SEG);
+    struct dedup_cubo *c = dedup_cubo_de(epoca);
+    uint64_t clave = dedup_clave(firma);
+
+    pthread_mutex_lock(&c->lock);
+    if (c->epoca == epoca) {
+        for (size_t i = clave & (DEDUP_SLOTS - 1); c->claves[i] != DEDUP_VACIO; i = (i + 1) & (DEDUP_SLOTS - 1)) {
+            if (dedup_coincide(c->claves[i], clave)) {
+                c->claves[i] = persistido ? clave : DEDUP_BORRADO;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+// Función segura para procesar solicitud ya leída y parseada por el bucle de eventos
+void handle_webhook_request(int client_socket, const struct sockaddr *client_addr, const char *client_ip,
+                            char *request, const struct http_parser *http) {
+    char response[MAX_AUTH_HEADER_SIZE];
     char auth_header[MAX_AUTH_HEADER_SIZE] = {0};
     char timestamp_header[MAX_AUTH_HEADER_SIZE] = {0};
     char *payment_data = NULL;
 
-    // Leer solicitud de forma segura
-    ssize_t bytes_read = read(client_socket, request, MAX_REQUEST_SIZE);
-    if (bytes_read <= 0) {
-        snprintf(response, sizeof(response), "HTTP/1.1 400 Bad Request\r\n\r\n");
-        write(client_socket, response, strlen(response));
-        close(client_socket);
-        return;
-    }
-    request[bytes_read] = '\0';
-
     // Verificar IP autorizada
-    if (!is_ip_authorized(client_ip)) {
+    if (!is_ip_authorized(client_addr)) {
         snprintf(response, sizeof(response), 
             "HTTP/1.1 403 Forbidden\r\n"
             "Content-Type: application/json\r\n\r\n"
@@ -149,8 +988,8 @@ void handle_webhook_request(int client_socket, const char *client_ip) {
     }
 
     // Extraer encabezados de forma segura
-    if (!extract_header(request, "X-Signature: ", auth_header, sizeof(auth_header)) ||
-        !extract_header(request, "X-Timestamp: ", timestamp_header, sizeof(timestamp_header))) {
+    if (!extract_header(http, request, "X-Signature", auth_header, sizeof(auth_header)) ||
+        !extract_header(http, request, "X-Timestamp", timestamp_header, sizeof(timestamp_header))) {
         snprintf(response, sizeof(response), 
             "HTTP/1.1 400 Bad Request\r\n"
             "Content-Type: application/json\r\n\r\n"
@@ -160,26 +999,21 @@ void handle_webhook_request(int client_socket, const char *client_ip) {
         return;
     }
 
-    // Buscar datos del pago (validar formato JSON)
-    payment_data = strstr(request, "\r\n\r\n");
-    if (!payment_data || strlen(payment_data + 4) == 0) {
-        payment_data = strstr(request, "\n\n");
-        if (!payment_data || strlen(payment_data + 2) == 0) {
-            snprintf(response, sizeof(response), 
-                "HTTP/1.1 400 Bad Request\r\n"
-                "Content-Type: application/json\r\n\r\n"
-                "{\"error\":\"Invalid payload\"}");
-            write(client_socket, response, strlen(response));
-            close(client_socket);
-            return;
-        }
-        payment_data += 2;
-    } else {
-        payment_data += 4;
+    // Datos del pago: el cuerpo ya decodificado (Content-Length o chunked)
+    if (http->cuerpo.len == 0) {
+        snprintf(response, sizeof(response), 
+            "HTTP/1.1 400 Bad Request\r\n"
+            "Content-Type: application/json\r\n\r\n"
+            "{\"error\":\"Invalid payload\"}");
+        write(client_socket, response, strlen(response));
+        close(client_socket);
+        return;
     }
+    payment_data = request + http->cuerpo.inicio;
+    payment_data[http->cuerpo.len] = '\0';
 
     // Validar HMAC con timestamp
-    if (!validate_hmac(payment_data, auth_header, timestamp_header)) {
+    if (!validate_hmac(payment_data, http->cuerpo.len, auth_header, timestamp_header)) {
         snprintf(response, sizeof(response), 
             "HTTP/1.1 401 Unauthorized\r\n"
             "Content-Type: application/json\r\n\r\n"
@@ -189,8 +1023,54 @@ void handle_webhook_request(int client_socket, const char *client_ip) {
         return;
     }
 
-    // Procesar pago (aquí iría la lógica real)
-    printf("Procesando pago válido de %s\n", client_ip);
+    // Reenvío de una entrega ya aceptada: se confirma sin volver a procesarla
+    unsigned char firma[SHA256_DIGEST_LENGTH];
+    time_t req_time = atol(timestamp_header);
+    decodificar_firma(auth_header, firma, sizeof(firma));
+    enum dedup_resultado dedup = dedup_registrar(firma, req_time);
+    if (dedup == DEDUP_DUPLICADA) {
+        snprintf(response, sizeof(response), 
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: application/json\r\n\r\n"
+            "{\"status\":\"duplicate\"}");
+        write(client_socket, response, strlen(response));
+        close(client_socket);
+        return;
+    }
+    if (dedup == DEDUP_PENDIENTE) {
+        // El original aún se está encolando y puede fallar: el proveedor debe reintentar
+        snprintf(response, sizeof(response), 
+            "HTTP/1.1 409 Conflict\r\n"
+            "Content-Type: application/json\r\n"
+            "Retry-After: 1\r\n\r\n"
+            "{\"error\":\"Delivery in progress\"}");
+        write(client_socket, response, strlen(response));
+        close(client_socket);
+        return;
+    }
+    if (dedup == DEDUP_LLENO) {
+        // El proveedor reintentará; mejor que arriesgar un doble cobro
+        snprintf(response, sizeof(response), 
+            "HTTP/1.1 503 Service Unavailable\r\n"
+            "Content-Type: application/json\r\n\r\n"
+            "{\"error\":\"Replay index full\"}");
+        write(client_socket, response, strlen(response));
+        close(client_socket);
+        return;
+    }
+
+    // Persistir el pago en la cola; el consumidor lo procesa fuera de la petición
+    if (!cola_pagos_encolar(payment_data, http->cuerpo.len, client_ip)) {
+        dedup_resolver(firma, req_time, false);
+        snprintf(response, sizeof(response), 
+            "HTTP/1.1 503 Service Unavailable\r\n"
+            "Content-Type: application/json\r\n\r\n"
+            "{\"error\":\"Queue unavailable\"}");
+        write(client_socket, response, strlen(response));
+        close(client_socket);
+        return;
+    }
+    dedup_resolver(firma, req_time, true);
 
     // Responder
     snprintf(response, sizeof(response), 
@@ -201,12 +1081,770 @@ void handle_webhook_request(int client_socket, const char *client_ip) {
     close(client_socket);
 }
 
-int main() {
-    int server_fd, client_socket;
+
+// Conexión en curso: el bucle de eventos acumula la petición y un worker la atiende
+struct peticion {
+    int fd;
+    struct sockaddr_in addr;
+    char client_ip[INET_ADDRSTRLEN];
+    char *datos;                 // Se conserva entre conexiones; capacidad + 1 para el '\0'
+    size_t capacidad;
+    size_t len;
+    struct http_parser http;
+    int siguiente_libre;
+    // Plazo de lectura, sólo lo toca el bucle de eventos
+    long inicio;
+    long ultima_lectura;
+    long plazo;
+    int ranura;
+    int sig_rueda;
+    int ant_rueda;
+};
+
+static struct peticion *peticiones;
+static int primera_libre = -1;
+static pthread_mutex_t peticiones_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Cola acotada de peticiones completas hacia los workers
+static struct {
+    int items[COLA_PETICIONES];
+    int cabeza;
+    int pendientes;
+    pthread_mutex_t lock;
+    pthread_cond_t hay_trabajo;
+} cola = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .hay_trabajo = PTHREAD_COND_INITIALIZER
+};
+
+// Rueda de plazos del bucle de eventos: una ranura por segundo. Una conexión
+// cuyo plazo se alarga sigue en su ranura y se recoloca al vencer ésta, así
+// cada lectura sólo actualiza un campo
+static int rueda[RUEDA_RANURAS];
+static long rueda_ultimo;
+
+static long segundos_monotonicos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec;
+}
+
+static void rueda_insertar(int idx) {
+    struct peticion *p = &peticiones[idx];
+    p->ranura = (int)(p->plazo % RUEDA_RANURAS);
+    p->ant_rueda = -1;
+    p->sig_rueda = rueda[p->ranura];
+    if (p->sig_rueda >= 0) peticiones[p->sig_rueda].ant_rueda = idx;
+    rueda[p->ranura] = idx;
+}
+
+static void rueda_quitar(int idx) {
+    struct peticion *p = &peticiones[idx];
+    if (p->ant_rueda >= 0) peticiones[p->ant_rueda].sig_rueda = p->sig_rueda;
+    else rueda[p->ranura] = p->sig_rueda;
+    if (p->sig_rueda >= 0) peticiones[p->sig_rueda].ant_rueda = p->ant_rueda;
+}
+
+// Inactividad, cabeceras lentas (slowloris) y cuerpo lento tienen límites propios
+static void calcular_plazo(struct peticion *p) {
+    long limite = p->inicio + (p->http.estado > HTTP_CABECERAS ? TIMEOUT_PETICION : TIMEOUT_CABECERAS);
+    long inactividad = p->ultima_lectura + TIMEOUT_INACTIVIDAD;
+    p->plazo = inactividad < limite ? inactividad : limite;
+}
+
+static bool peticiones_init(void) {
+    peticiones = calloc(MAX_CONEXIONES, sizeof(struct peticion));
+    if (!peticiones) return false;
+    for (int i = 0; i < MAX_CONEXIONES; i++) {
+        peticiones[i].siguiente_libre = (i + 1 < MAX_CONEXIONES) ? i + 1 : -1;
+    }
+    primera_libre = 0;
+    return true;
+}
+
+static int peticion_acquire(void) {
+    pthread_mutex_lock(&peticiones_lock);
+    int idx = primera_libre;
+    if (idx >= 0) {
+        primera_libre = peticiones[idx].siguiente_libre;
+    }
+    pthread_mutex_unlock(&peticiones_lock);
+    return idx;
+}
+
+static void peticion_release(int idx) {
+    pthread_mutex_lock(&peticiones_lock);
+    peticiones[idx].siguiente_libre = primera_libre;
+    primera_libre = idx;
+    pthread_mutex_unlock(&peticiones_lock);
+}
+
+static bool encolar(int idx) {
+    bool ok = false;
+    pthread_mutex_lock(&cola.lock);
+    if (cola.pendientes < COLA_PETICIONES) {
+        cola.items[(cola.cabeza + cola.pendientes) % COLA_PETICIONES] = idx;
+        cola.pendientes++;
+        ok = true;
+        pthread_cond_signal(&cola.hay_trabajo);
+    }
+    pthread_mutex_unlock(&cola.lock);
+    return ok;
+}
+
+static void *worker(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&cola.lock);
+        while (cola.pendientes == 0) {
+            pthread_cond_wait(&cola.hay_trabajo, &cola.lock);
+        }
+        int idx = cola.items[cola.cabeza];
+        cola.cabeza = (cola.cabeza + 1) % COLA_PETICIONES;
+        cola.pendientes--;
+        pthread_mutex_unlock(&cola.lock);
+
+        struct peticion *p = &peticiones[idx];
+        handle_webhook_request(p->fd, (struct sockaddr *)&p->addr, p->client_ip, p->datos, &p->http);
+        peticion_release(idx);
+    }
+    return NULL;
+}
+
+static void responder_y_cerrar(int fd, const char *response) {
+    write(fd, response, strlen(response));
+    close(fd);
+}
+
+static void rechazar_saturado(int fd) {
+    responder_y_cerrar(fd,
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Content-Type: application/json\r\n\r\n"
+        "{\"error\":\"Server busy\"}");
+}
+
+static void aceptar_conexiones(int server_fd, int epfd) {
+    while (1) {
+        struct sockaddr_in address;
+        socklen_t addrlen = sizeof(address);
+        int fd = accept4(server_fd, (struct sockaddr *)&address, &addrlen, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("accept");
+            return;
+        }
+
+        int idx = peticion_acquire();
+        if (idx < 0) {
+            rechazar_saturado(fd);
+            continue;
+        }
+        struct peticion *p = &peticiones[idx];
+        if (!p->datos) {
+            p->datos = malloc(BUFFER_INICIAL + 1);
+            p->capacidad = p->datos ? BUFFER_INICIAL : 0;
+        }
+        if (!p->datos) {
+            rechazar_saturado(fd);
+            peticion_release(idx);
+            continue;
+        }
+        p->fd = fd;
+        p->len = 0;
+        http_parser_init(&p->http, MAX_REQUEST_SIZE);
+        p->addr = address;
+        inet_ntop(AF_INET, &address.sin_addr, p->client_ip, INET_ADDRSTRLEN);
+
+        struct epoll_event ev = {.events = EPOLLIN, .data.u64 = (uint64_t)idx + 1};
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            peticion_release(idx);
+            continue;
+        }
+        p->inicio = p->ultima_lectura = segundos_monotonicos();
+        calcular_plazo(p);
+        rueda_insertar(idx);
+    }
+}
+
+// Lee lo disponible sin bloquear, avanza el parser y entrega la petición a los workers
+static void leer_peticion(int epfd, int idx) {
+    struct peticion *p = &peticiones[idx];
+    bool cerrada = false;
+    int estado = HTTP_INCOMPLETA;
+
+    while (estado == HTTP_INCOMPLETA) {
+        if (p->len == p->capacidad) {
+            if (p->capacidad >= MAX_REQUEST_SIZE) {
+                estado = HTTP_DEMASIADO_GRANDE;
+                break;
+            }
+            size_t nueva = p->capacidad * 2;
+            char *datos = realloc(p->datos, nueva + 1);
+            if (!datos) {
+                estado = HTTP_DEMASIADO_GRANDE;
+                break;
+            }
+            p->datos = datos;
+            p->capacidad = nueva;
+        }
+
+        ssize_t n = read(p->fd, p->datos + p->len, p->capacidad - p->len);
+        if (n > 0) {
+            p->len += (size_t)n;
+            p->ultima_lectura = segundos_monotonicos();
+            estado = http_parser_execute(&p->http, p->datos, p->len);
+            continue;
+        }
+        if (n == 0) cerrada = true;
+        else if (errno == EINTR) continue;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK) cerrada = true;
+        break;
+    }
+
+    if (estado == HTTP_INCOMPLETA && !cerrada) {
+        calcular_plazo(p);
+        return;
+    }
+
+    rueda_quitar(idx);
+    epoll_ctl(epfd, EPOLL_CTL_DEL, p->fd, NULL);
+    if (estado == HTTP_INCOMPLETA && p->len == 0) {
+        close(p->fd);
+    } else if (estado == HTTP_DEMASIADO_GRANDE) {
+        responder_y_cerrar(p->fd,
+            "HTTP/1.1 413 Payload Too Large\r\n"
+            "Content-Type: application/json\r\n\r\n"
+            "{\"error\":\"Request too large\"}");
+    } else if (estado != HTTP_LISTA) {
+        responder_y_cerrar(p->fd,
+            "HTTP/1.1 400 Bad Request\r\n"
+            "Content-Type: application/json\r\n\r\n"
+            "{\"error\":\"Malformed request\"}");
+    } else {
+        // El worker escribe la respuesta con el socket en modo bloqueante
+        int flags = fcntl(p->fd, F_GETFL);
+        fcntl(p->fd, F_SETFL, flags & ~O_NONBLOCK);
+        if (encolar(idx)) return;
+        rechazar_saturado(p->fd);
+    }
+    peticion_release(idx);
+}
+
+// Avanza la rueda hasta ahora: cierra con 408 las conexiones vencidas y
+// recoloca las que alargaron su plazo desde que se insertaron
+static void rueda_avanzar(int epfd, long ahora) {
+    long pasos = ahora - rueda_ultimo;
+    if (pasos > RUEDA_RANURAS) pasos = RUEDA_RANURAS;
+    for (long t = ahora - pasos + 1; t <= ahora; t++) {
+        int ranura = (int)(t % RUEDA_RANURAS);
+        int idx = rueda[ranura];
+        rueda[ranura] = -1;
+        while (idx >= 0) {
+            struct peticion *p = &peticiones[idx];
+            int siguiente = p->sig_rueda;
+            if (p->plazo > ahora) {
+                rueda_insertar(idx);
+            } else {
+                epoll_ctl(epfd, EPOLL_CTL_DEL, p->fd, NULL);
+                responder_y_cerrar(p->fd,
+                    "HTTP/1.1 408 Request Timeout\r\n"
+                    "Content-Type: application/json\r\n"
+                    "Connection: close\r\n\r\n"
+                    "{\"error\":\"Request timeout\"}");
+                peticion_release(idx);
+            }
+            idx = siguiente;
+        }
+    }
+    rueda_ultimo = ahora;
+}
+
+// Bucle de eventos: acepta y lee sin bloquear; la validación y el pago van a los workers
+static void servir(int server_fd, int num_workers) {
+    int flags = fcntl(server_fd, F_GETFL);
+    fcntl(server_fd, F_SETFL, flags | O_NONBLOCK);
+
+    int epfd = epoll_create1(0);
+    struct epoll_event ev = {.events = EPOLLIN, .data.u64 = 0};
+    if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, server_fd, &ev) < 0) {
+        perror("epoll");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, worker, NULL) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(tid);
+    }
+
+    for (int i = 0; i < RUEDA_RANURAS; i++) {
+        rueda[i] = -1;
+    }
+    rueda_ultimo = segundos_monotonicos();
+
+    struct epoll_event eventos[MAX_EVENTOS];
+    while (1) {
+        // Despierta al menos una vez por segundo para cerrar conexiones estancadas
+        int n = epoll_wait(epfd, eventos, MAX_EVENTOS, 1000);
+        for (int i = 0; i < n; i++) {
+            if (eventos[i].data.u64 == 0) {
+                aceptar_conexiones(server_fd, epfd);
+            } else {
+                leer_peticion(epfd, (int)(eventos[i].data.u64 - 1));
+            }
+        }
+        long ahora = segundos_monotonicos();
+        if (ahora != rueda_ultimo) rueda_avanzar(epfd, ahora);
+    }
+}
+
+struct servidor_args {
+    int server_fd;
+    int num_workers;
+};
+
+static void *servir_hilo(void *arg) {
+    struct servidor_args *a = arg;
+    servir(a->server_fd, a->num_workers);
+    return NULL;
+}
+
+// Benchmark: webhooks firmados por segundo con concurrencia de 1 a 512 clientes
+struct bench_cliente {
+    int id;
+    int peticiones;
+    const char *secret_key;
+    int ok;
+    int fallos;
+};
+
+static void *bench_cliente_hilo(void *arg) {
+    struct bench_cliente *c = arg;
+    static int ronda = 0;
+    int ronda_actual = __atomic_add_fetch(&ronda, 1, __ATOMIC_RELAXED);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(PORT)};
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    for (int i = 0; i < c->peticiones; i++) {
+        // Identificador único por entrega para que el índice de reenvíos no las descarte
+        char payload[128];
+        snprintf(payload, sizeof(payload),
+                 "{\"payment\":{\"id\":\"pay_%d_%d_%d\",\"amount\":1000,\"currency\":\"EUR\"}}",
+                 ronda_actual, c->id, i);
+        char timestamp[32], signature[SHA256_DIGEST_LENGTH * 2 + 1];
+        char request[MAX_REQUEST_SIZE], response[512];
+        unsigned char digest[SHA256_DIGEST_LENGTH];
+        unsigned char mensaje[256];
+
+        int ts_len = snprintf(timestamp, sizeof(timestamp), "%ld", (long)time(NULL));
+        int msg_len = snprintf((char *)mensaje, sizeof(mensaje), "%s%s", timestamp, payload);
+        HMAC(EVP_sha256(), c->secret_key, (int)strlen(c->secret_key), mensaje, (size_t)msg_len, digest, NULL);
+        for (int j = 0; j < SHA256_DIGEST_LENGTH; j++) {
+            snprintf(&signature[j * 2], 3, "%02x", digest[j]);
+        }
+        int len = snprintf(request, sizeof(request),
+                           "POST /webhook HTTP/1.1\r\nHost: localhost\r\n"
+                           "X-Signature: %s\r\nX-Timestamp: %.*s\r\n"
+                           "Content-Length: %zu\r\n\r\n%s",
+                           signature, ts_len, timestamp, strlen(payload), payload);
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        ssize_t leidos = -1;
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+            write(fd, request, (size_t)len) == len) {
+            leidos = read(fd, response, sizeof(response) - 1);
+        }
+        if (leidos > 0) response[leidos] = '\0';
+        if (fd >= 0) close(fd);
+
+        if (leidos > 12 && strncmp(response, "HTTP/1.1 200", 12) == 0 &&
+            strstr(response, "\"success\"")) c->ok++;
+        else c->fallos++;
+    }
+    return NULL;
+}
+
+// Los benchmarks usan una clave temporal en lugar de SECRET_KEY_FILE
+static void crear_clave_bench(char *key_file, const char *secret_key) {
+    int kfd = mkstemp(key_file);
+    if (kfd < 0 || write(kfd, secret_key, strlen(secret_key)) < 0) {
+        perror("mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    close(kfd);
+    secret_key_file = key_file;
+    if (!claves_init()) {
+        fprintf(stderr, "Error al cargar la clave de benchmark\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void run_bench(int server_fd, int num_workers, int peticiones) {
+    char key_file[] = "/tmp/webhook_bench_XXXXXX";
+    const char *secret_key = "clave-de-benchmark";
+    crear_clave_bench(key_file, secret_key);
+    silencioso = true;
+
+    // Sólo loopback autorizado, cargado desde fichero como en producción
+    char allowlist_file[] = "/tmp/webhook_allowlist_XXXXXX";
+    int afd = mkstemp(allowlist_file);
+    if (afd < 0 || write(afd, "127.0.0.0/8\n", 12) != 12 || !allowlist_init(allowlist_file, NULL)) {
+        perror("allowlist");
+        exit(EXIT_FAILURE);
+    }
+    close(afd);
+
+    static struct servidor_args args;
+    args = (struct servidor_args){server_fd, num_workers};
+    pthread_t servidor;
+    pthread_create(&servidor, NULL, servir_hilo, &args);
+
+    static pthread_t hilos[BENCH_MAX_CONCURRENCIA];
+    static struct bench_cliente clientes[BENCH_MAX_CONCURRENCIA];
+    printf("%-12s %12s %8s\n", "concurrencia", "webhooks/s", "fallos");
+    for (int conc = 1; conc <= BENCH_MAX_CONCURRENCIA; conc *= 2) {
+        int por_cliente = peticiones / conc > 0 ? peticiones / conc : 1;
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < conc; i++) {
+            clientes[i] = (struct bench_cliente){.id = i, .peticiones = por_cliente, .secret_key = secret_key};
+            pthread_create(&hilos[i], NULL, bench_cliente_hilo, &clientes[i]);
+        }
+        int ok = 0, fallos = 0;
+        for (int i = 0; i < conc; i++) {
+            pthread_join(hilos[i], NULL);
+            ok += clientes[i].ok;
+            fallos += clientes[i].fallos;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double seg = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        printf("%-12d %12.0f %8d\n", conc, ok / seg, fallos);
+    }
+    unlink(key_file);
+    unlink(allowlist_file);
+}
+
+// Benchmark de la cola durable: anexados/s según modo de sincronización y ventana de grupo
+struct bench_cola_hilo {
+    int registros;
+};
+
+static void *bench_cola_productor(void *arg) {
+    struct bench_cola_hilo *h = arg;
+    const char *payload = "{\"payment\":{\"id\":\"pay_123\",\"amount\":1000,\"currency\":\"EUR\"}}";
+    for (int i = 0; i < h->registros; i++) {
+        cola_pagos_encolar(payload, strlen(payload), "127.0.0.1");
+    }
+    return NULL;
+}
+
+static void run_bench_cola(int registros, int hilos) {
+    struct { bool fsync; int grupo_us; } modos[] = {
+        {false, 0}, {true, 0}, {true, 100}, {true, GROUP_COMMIT_US}, {true, 1000}
+    };
+    char ruta[] = "/tmp/webhook_cola_XXXXXX";
+    int tmp = mkstemp(ruta);
+    if (tmp < 0) {
+        perror("mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    close(tmp);
+    char ruta_offset[64];
+    snprintf(ruta_offset, sizeof(ruta_offset), "%s.offset", ruta);
+    silencioso = true;
+
+    pthread_t tids[WORKERS * 8];
+    struct bench_cola_hilo args[WORKERS * 8];
+    if (hilos > WORKERS * 8) hilos = WORKERS * 8;
+
+    printf("%-8s %8s %12s %16s %14s\n", "modo", "grupo_us", "anexados/s", "registros/grupo", "ms/escritura");
+    for (size_t m = 0; m < sizeof(modos) / sizeof(modos[0]); m++) {
+        unlink(ruta);
+        unlink(ruta_offset);
+        if (!cola_pagos_init(ruta, modos[m].fsync, modos[m].grupo_us)) exit(EXIT_FAILURE);
+
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < hilos; i++) {
+            args[i].registros = registros / hilos;
+            pthread_create(&tids[i], NULL, bench_cola_productor, &args[i]);
+        }
+        for (int i = 0; i < hilos; i++) pthread_join(tids[i], NULL);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        double seg = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        uint64_t grupos = cola_pagos.grupos ? cola_pagos.grupos : 1;
+        printf("%-8s %8d %12.0f %16.1f %14.3f\n", modos[m].fsync ? "fsync" : "write",
+               modos[m].grupo_us, cola_pagos.registros / seg, (double)cola_pagos.registros / grupos,
+               cola_pagos.ns_escritura / 1e6 / grupos);
+        cola_pagos_cerrar();
+    }
+    unlink(ruta);
+    unlink(ruta_offset);
+}
+
+// Microbenchmark del índice de reenvíos: coste por registro, tasa de aciertos y memoria
+static void run_bench_dedup(int operaciones) {
+    unsigned char firma[SHA256_DIGEST_LENGTH] = {0};
+    unsigned int semilla = 1;
+    time_t ahora = time(NULL);
+    int duplicadas = 0, reenvios = 0;
+    silencioso = true;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < operaciones; i++) {
+        // Uno de cada diez es el reenvío de una entrega reciente
+        int n = i;
+        if (i > 100 && rand_r(&semilla) % 10 == 0) {
+            n = i - 1 - (int)(rand_r(&semilla) % 100);
+            reenvios++;
+        }
+        uint64_t h = (uint64_t)n * 0x9E3779B97F4A7C15ull;
+        memcpy(firma, &h, sizeof(h));
+        // Los timestamps se reparten por la ventana, como entregas con retrasos distintos
+        time_t ts = ahora - MAX_TIMESTAMP_DIFF + (n % (2 * MAX_TIMESTAMP_DIFF + 1));
+        enum dedup_resultado r = dedup_registrar(firma, ts);
+        if (r == DEDUP_NUEVA) dedup_resolver(firma, ts, true);
+        duplicadas += r == DEDUP_DUPLICADA;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / operaciones;
+    printf("%.1f ns/registro, reenvíos %d, detectados %d\n", ns, reenvios, duplicadas);
+    dedup_report();
+}
+
+// Microbenchmark de la lista CIDR: trie frente a la comparación lineal de cadenas
+static void run_bench_allowlist(int busquedas) {
+    const int num_v4 = 5000, num_v6 = 2000;
+    unsigned int semilla = 7;
+    struct ip_allowlist *l = allowlist_crear();
+    char **lineal = malloc(num_v4 * sizeof(char *));
+    char texto[ALLOWLIST_LINEA_MAX];
+
+    for (int i = 0; i < num_v4; i++) {
+        uint32_t ip = (uint32_t)rand_r(&semilla) << 1 ^ (uint32_t)rand_r(&semilla);
+        int bits = 12 + rand_r(&semilla) % 21;
+        snprintf(texto, sizeof(texto), "%u.%u.%u.%u/%d", ip >> 24, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, bits);
+        allowlist_anadir_texto(l, texto);
+        lineal[i] = strdup(texto);
+        *strchr(lineal[i], '/') = '\0';
+    }
+    for (int i = 0; i < num_v6; i++) {
+        snprintf(texto, sizeof(texto), "2001:%x:%x:%x::/%d", rand_r(&semilla) & 0xFFFF,
+                 rand_r(&semilla) & 0xFFFF, rand_r(&semilla) & 0xFFFF, 20 + rand_r(&semilla) % 45);
+        allowlist_anadir_texto(l, texto);
+    }
+    allowlist_compilar(l);
+
+    struct sockaddr_in *dirs = malloc(busquedas * sizeof(*dirs));
+    for (int i = 0; i < busquedas; i++) {
+        dirs[i] = (struct sockaddr_in){.sin_family = AF_INET};
+        dirs[i].sin_addr.s_addr = (uint32_t)rand_r(&semilla) << 1 ^ (uint32_t)rand_r(&semilla);
+    }
+
+    struct timespec t0, t1;
+    int aciertos = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < busquedas; i++) {
+        aciertos += allowlist_contiene_sockaddr(l, (struct sockaddr *)&dirs[i]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ns_trie = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / busquedas;
+
+    // Ruta anterior: inet_ntop + strcmp contra cada entrada (sólo IPs exactas)
+    int lineales = busquedas < 20000 ? busquedas : 20000;
+    int iguales = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < lineales; i++) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &dirs[i].sin_addr, ip, sizeof(ip));
+        for (int j = 0; j < num_v4; j++) {
+            if (strcmp(ip, lineal[j]) == 0) {
+                iguales++;
+                break;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ns_lineal = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / lineales;
+
+    printf("%d prefijos (%d IPv4, %d IPv6), %u nodos, %zu KB\n", l->prefijos, num_v4, num_v6,
+           l->num_nodos, (size_t)l->num_nodos * sizeof(struct allowlist_nodo) / 1024);
+    printf("trie:   %8.1f ns/búsqueda (%d de %d autorizadas)\n", ns_trie, aciertos, busquedas);
+    printf("lineal: %8.1f ns/búsqueda (%d coincidencias exactas)\n", ns_lineal, iguales);
+
+    for (int i = 0; i < num_v4; i++) free(lineal[i]);
+    free(lineal);
+    free(dirs);
+    allowlist_liberar(l);
+}
+
+// Microbenchmark de validaciones/s: ruta original frente a contexto por hilo
+static void run_bench_hmac(int iteraciones) {
+    char key_file[] = "/tmp/webhook_bench_XXXXXX";
+    const char *secret_key = "clave-de-benchmark";
+    const char *payload = "{\"payment\":{\"id\":\"pay_123\",\"amount\":1000,\"currency\":\"EUR\"}}";
+    char timestamp[32], signature[SHA256_DIGEST_LENGTH * 2 + 1];
+    unsigned char mensaje[256], digest[SHA256_DIGEST_LENGTH];
+
+    crear_clave_bench(key_file, secret_key);
+    snprintf(timestamp, sizeof(timestamp), "%ld", (long)time(NULL));
+    int msg_len = snprintf((char *)mensaje, sizeof(mensaje), "%s%s", timestamp, payload);
+    HMAC(EVP_sha256(), secret_key, (int)strlen(secret_key), mensaje, (size_t)msg_len, digest, NULL);
+    for (int j = 0; j < SHA256_DIGEST_LENGTH; j++) {
+        snprintf(&signature[j * 2], 3, "%02x", digest[j]);
+    }
+
+    for (int modo = 0; modo < 2; modo++) {
+        int validas = 0;
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < iteraciones; i++) {
+            validas += modo == 0 ? validate_hmac_sin_cache(payload, signature, timestamp)
+                                 : validate_hmac(payload, strlen(payload), signature, timestamp);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double seg = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        printf("%-34s %10.0f validaciones/s %s\n",
+               modo == 0 ? "HMAC_CTX nuevo + sprintf" : "claves en memoria + contexto por hilo",
+               iteraciones / seg, validas == iteraciones ? "" : "(FALLOS)");
+    }
+    unlink(key_file);
+}
+
+// Microbenchmark del parser: petición con Content-Length y chunked, entera y en fragmentos
+static double bench_parser_caso(const char *nombre, const char *plantilla, size_t fragmento,
+                                int iteraciones, const char *cuerpo_esperado) {
+    size_t total = strlen(plantilla);
+    char *buf = malloc(total + 1);
+    struct http_parser http;
+    int estado = HTTP_INCOMPLETA;
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < iteraciones; i++) {
+        // Copia necesaria: el cuerpo chunked se compacta sobre el propio buffer
+        memcpy(buf, plantilla, total);
+        http_parser_init(&http, MAX_REQUEST_SIZE);
+        for (size_t len = 0; len < total;) {
+            len = (len + fragmento < total) ? len + fragmento : total;
+            estado = http_parser_execute(&http, buf, len);
+            if (estado != HTTP_INCOMPLETA) break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    bool correcto = estado == HTTP_LISTA && http.cuerpo.len == strlen(cuerpo_esperado) &&
+                    memcmp(buf + http.cuerpo.inicio, cuerpo_esperado, http.cuerpo.len) == 0;
+    double ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / iteraciones;
+    printf("%-28s fragmento %5zu: %8.1f ns/petición %8.1f MB/s %s\n", nombre, fragmento, ns,
+           total / ns * 1e3, correcto ? "" : "(RESULTADO INCORRECTO)");
+    free(buf);
+    return ns;
+}
+
+static void run_bench_parser(int iteraciones) {
+    char cuerpo[1025];
+    char con_longitud[2048];
+    char chunked[2048];
+
+    for (int i = 0; i < 1024; i++) {
+        cuerpo[i] = "0123456789abcdef"[i % 16];
+    }
+    cuerpo[1024] = '\0';
+
+    const char *cabeceras =
+        "POST /webhook HTTP/1.1\r\nHost: payments.example.com\r\n"
+        "User-Agent: provider-webhooks/2.1\r\nContent-Type: application/json\r\n"
+        "X-Signature: 3f1c0c6a9d2b4e5f60718293a4b5c6d7e8f90123456789abcdef0123456789ab\r\n"
+        "X-Timestamp: 1700000000\r\n";
+    snprintf(con_longitud, sizeof(con_longitud), "%sContent-Length: 1024\r\n\r\n%s", cabeceras, cuerpo);
+    snprintf(chunked, sizeof(chunked),
+             "%sTransfer-Encoding: chunked\r\n\r\n100\r\n%.256s\r\n100\r\n%.256s\r\n"
+             "200\r\n%.512s\r\n0\r\n\r\n", cabeceras, cuerpo, cuerpo + 256, cuerpo + 512);
+
+    size_t fragmentos[] = {sizeof(con_longitud), 512, 64};
+    for (size_t i = 0; i < sizeof(fragmentos) / sizeof(fragmentos[0]); i++) {
+        bench_parser_caso("Content-Length (1 KB)", con_longitud, fragmentos[i], iteraciones, cuerpo);
+        bench_parser_caso("chunked (1 KB, 3 trozos)", chunked, fragmentos[i], iteraciones, cuerpo);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int server_fd;
     struct sockaddr_in address;
     int opt = 1;
-    int addrlen = sizeof(address);
-    char client_ip[INET_ADDRSTRLEN];
+    int num_workers = WORKERS;
+    int bench_peticiones = 0;
+    int bench_parser = 0;
+    int bench_hmac = 0;
+    int bench_cola = 0;
+    int bench_dedup = 0;
+    int bench_allowlist = 0;
+    const char *allowlist_file = ALLOWLIST_FILE;
+    const char *queue_file = QUEUE_FILE;
+    bool queue_fsync = true;
+    int group_us = GROUP_COMMIT_US;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--workers") == 0) {
+            num_workers = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench_peticiones = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--bench-parser") == 0) {
+            bench_parser = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--bench-hmac") == 0) {
+            bench_hmac = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--key-file") == 0) {
+            secret_key_file = argv[i + 1];
+        } else if (strcmp(argv[i], "--allowlist") == 0) {
+            allowlist_file = argv[i + 1];
+        } else if (strcmp(argv[i], "--bench-allowlist") == 0) {
+            bench_allowlist = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--bench-dedup") == 0) {
+            bench_dedup = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--bench-cola") == 0) {
+            bench_cola = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--queue") == 0) {
+            queue_file = argv[i + 1];
+        } else if (strcmp(argv[i], "--sync") == 0) {
+            queue_fsync = strcmp(argv[i + 1], "write") != 0;
+        } else if (strcmp(argv[i], "--group-us") == 0) {
+            group_us = atoi(argv[i + 1]);
+        }
+    }
+    if (num_workers < 1) num_workers = WORKERS;
+
+    if (!dedup_init()) {
+        fprintf(stderr, "Error: sin memoria para el índice de reenvíos\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (bench_allowlist > 0) {
+        run_bench_allowlist(bench_allowlist);
+        return 0;
+    }
+    if (bench_dedup > 0) {
+        run_bench_dedup(bench_dedup);
+        return 0;
+    }
+    if (bench_parser > 0) {
+        run_bench_parser(bench_parser);
+        return 0;
+    }
+    if (bench_hmac > 0) {
+        run_bench_hmac(bench_hmac);
+        return 0;
+    }
+    if (bench_cola > 0) {
+        run_bench_cola(bench_cola, num_workers);
+        return 0;
+    }
 
     // Verificar privilegios
     if (geteuid() == 0) {
@@ -214,8 +1852,13 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
+    if (!peticiones_init()) {
+        fprintf(stderr, "Error: sin memoria para las conexiones\n");
+        exit(EXIT_FAILURE);
+    }
+
     // Crear socket
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
         perror("socket failed");
         exit(EXIT_FAILURE);
     }
@@ -238,29 +1881,49 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
-    // Escuchar
-    if (listen(server_fd, 10) < 0) {
+    // Escuchar con una cola de aceptación amplia para absorber ráfagas del proveedor
+    if (listen(server_fd, SOMAXCONN) < 0) {
         perror("listen");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
 
-    printf("Webhook seguro escuchando en puerto %d...\n", PORT);
+    if (bench_peticiones > 0) {
+        char ruta[32] = "/tmp/webhook_cola_XXXXXX";
+        int tmp = mkstemp(ruta);
+        if (tmp < 0 || !cola_pagos_init(ruta, queue_fsync, group_us)) exit(EXIT_FAILURE);
+        close(tmp);
+        run_bench(server_fd, num_workers, bench_peticiones);
+        unlink(ruta);
+        strcat(ruta, ".offset");
+        unlink(ruta);
+        return 0;
+    }
 
-    while (1) {
-        // Aceptar conexión
-        if ((client_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
-            perror("accept");
-            continue;
-        }
+    // Claves de firma: se cargan una vez y se recargan con inotify o SIGHUP
+    if (!claves_init()) {
+        fprintf(stderr, "Error: no se pudo leer la clave secreta de %s\n", secret_key_file);
+        close(server_fd);
+        exit(EXIT_FAILURE);
+    }
+
+    // Lista de IPs: recarga automática al cambiar el fichero o con SIGHUP
+    if (!allowlist_init(allowlist_file, authorized_ips)) {
+        fprintf(stderr, "Error: lista de IPs autorizadas no válida\n");
+        close(server_fd);
+        exit(EXIT_FAILURE);
+    }
+    signal(SIGHUP, manejar_sighup);
 
-        // Obtener IP del cliente
-        inet_ntop(AF_INET, &(address.sin_addr), client_ip, INET_ADDRSTRLEN);
-        
-        // Manejar solicitud
-        handle_webhook_request(client_socket, client_ip);
+    if (!cola_pagos_init(queue_file, queue_fsync, group_us)) {
+        close(server_fd);
+        exit(EXIT_FAILURE);
     }
 
+    printf("Webhook seguro escuchando en puerto %d (%d workers, cola %s, %s, grupo %d us)...\n",
+           PORT, num_workers, queue_file, queue_fsync ? "fsync" : "sin fsync", group_us);
+    servir(server_fd, num_workers);
+
     close(server_fd);
     return 0;
-}
\ No newline at end of file
+}
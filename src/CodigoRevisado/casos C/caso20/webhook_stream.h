@@ -0,0 +1,452 @@
+#ifndef WEBHOOK_STREAM_H
+#define WEBHOOK_STREAM_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// Recepción en streaming del cuerpo de los webhooks microhttpd de caso20.
+// microhttpd entrega el cuerpo en trozos: cada trozo pasa por un tokenizador
+// JSON incremental que sólo conserva los campos que se procesan (status en la
+// raíz; id, amount y currency dentro del objeto "payment" de la raíz), de modo
+// que no hace falta construir un DOM ni tener el cuerpo entero en memoria.
+// Cuando sí se guarda, el buffer crece bajo demanda a partir de bloques
+// reciclados en un pool por hilo.
+
+#define POOL_BLOQUE 4096              // Tamaño de los bloques reciclados
+#define POOL_MAX_LIBRES 64            // Bloques que conserva cada hilo
+
+#define JSON_MAX_PROFUNDIDAD 64
+#define JSON_MAX_CLAVE 32
+#define JSON_MAX_VALOR 64
+
+// --- Pool de bloques por hilo ---
+
+struct pool_hilo {
+    void *libres[POOL_MAX_LIBRES];
+    int num_libres;
+};
+
+static __thread struct pool_hilo pool_local;
+
+static inline void *pool_obtener(void) {
+    if (pool_local.num_libres > 0) {
+        return pool_local.libres[--pool_local.num_libres];
+    }
+    return malloc(POOL_BLOQUE);
+}
+
+static inline void pool_devolver(void *bloque) {
+    if (!bloque) return;
+    if (pool_local.num_libres < POOL_MAX_LIBRES) {
+        pool_local.libres[pool_local.num_libres++] = bloque;
+    } else {
+        free(bloque);
+    }
+}
+
+// Buffer de cuerpo: empieza en un bloque del pool y sólo pasa a memoria propia
+// si el cuerpo no cabe en él
+struct buffer_cuerpo {
+    char *datos;
+    size_t len;
+    size_t cap;
+};
+
+static inline bool buffer_anadir(struct buffer_cuerpo *b, const char *datos, size_t n, size_t max) {
+    if (n > max - b->len) return false;
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : POOL_BLOQUE;
+        while (cap < b->len + n) cap *= 2;
+        if (cap > max) cap = max;
+
+        char *nuevo;
+        if (cap == POOL_BLOQUE) {
+            nuevo = pool_obtener();
+        } else if (b->cap == POOL_BLOQUE) {
+            nuevo = malloc(cap);
+            if (nuevo) {
+                memcpy(nuevo, b->datos, b->len);
+                pool_devolver(b->datos);
+            }
+        } else {
+            nuevo = realloc(b->datos, cap);
+        }
+        if (!nuevo) return false;
+        b->datos = nuevo;
+        b->cap = cap;
+    }
+    memcpy(b->datos + b->len, datos, n);
+    b->len += n;
+    return true;
+}
+
+static inline void buffer_liberar(struct buffer_cuerpo *b) {
+    if (b->cap == POOL_BLOQUE) pool_devolver(b->datos);
+    else free(b->datos);
+    memset(b, 0, sizeof(*b));
+}
+
+// --- Tokenizador JSON incremental ---
+
+enum json_campo { JSON_CAMPO_ID, JSON_CAMPO_AMOUNT, JSON_CAMPO_CURRENCY, JSON_CAMPO_STATUS, JSON_NUM_CAMPOS };
+
+// Ubicación exacta de cada campo: clave dentro de la raíz (padre NULL) o dentro
+// del objeto que cuelga de la clave padre de la raíz. Un "status" anidado, por
+// ejemplo el de un reembolso, no suplanta al del pago.
+struct json_ruta {
+    const char *padre;
+    const char *nombre;
+    bool solo_cadena;                 // Como json_string_value: otro tipo cuenta como ausente
+};
+
+static const struct json_ruta json_rutas[JSON_NUM_CAMPOS] = {
+    {"payment", "id", false},
+    {"payment", "amount", false},
+    {"payment", "currency", false},
+    {NULL, "status", true}
+};
+
+enum json_estado {
+    JSON_VALOR,                       // Se espera un valor
+    JSON_VALOR_O_CIERRE,              // Tras '[': un valor o ']'
+    JSON_CLAVE,                       // Tras ',' en un objeto: una clave
+    JSON_CLAVE_O_CIERRE,              // Tras '{': una clave o '}'
+    JSON_DOS_PUNTOS,
+    JSON_CADENA,
+    JSON_ESCAPE,
+    JSON_UNICODE,
+    JSON_LITERAL,                     // Número, true, false o null
+    JSON_TRAS_VALOR,                  // ',' o cierre del contenedor
+    JSON_FIN                          // Valor raíz completo: sólo espacios
+};
+
+// Posición dentro de un número (gramática de RFC 8259) o de true/false/null
+enum json_literal {
+    JSON_NUM_SIGNO,                   // Tras '-': falta un dígito
+    JSON_NUM_CERO,                    // Parte entera "0": no admite más dígitos
+    JSON_NUM_ENTERO,
+    JSON_NUM_PUNTO,                   // Tras '.': falta un dígito
+    JSON_NUM_FRACCION,
+    JSON_NUM_EXP,                     // Tras 'e'/'E': signo o dígito
+    JSON_NUM_EXP_SIGNO,               // Tras el signo del exponente: falta un dígito
+    JSON_NUM_EXP_DIGITOS,
+    JSON_PALABRA                      // true, false o null
+};
+
+struct json_extractor {
+    enum json_estado estado;
+    enum json_literal literal;
+    const char *palabra;              // Palabra esperada en JSON_PALABRA
+    size_t palabra_pos;
+    int profundidad;
+    bool es_objeto[JSON_MAX_PROFUNDIDAD];
+    bool es_padre[JSON_MAX_PROFUNDIDAD]; // Objeto abierto como valor de una clave padre de la raíz
+    bool clave_padre;                 // La última clave de la raíz es una clave padre
+    bool en_clave;
+    char clave[JSON_MAX_CLAVE];
+    size_t clave_len;
+    bool clave_larga;
+    int campo;                        // Campo que se está capturando o -1
+    int unicode_restante;
+    bool error;
+    unsigned int vistos;              // Bit por campo cuya clave ya apareció
+    unsigned int encontrados;         // Bit por campo ya capturado
+    char valores[JSON_NUM_CAMPOS][JSON_MAX_VALOR + 1];
+    size_t valor_len[JSON_NUM_CAMPOS];
+};
+
+static inline void json_extractor_init(struct json_extractor *j) {
+    memset(j, 0, sizeof(*j));
+    j->estado = JSON_VALOR;
+    j->campo = -1;
+}
+
+// Valor capturado del campo o NULL si no apareció en el documento
+static inline const char *json_campo(const struct json_extractor *j, enum json_campo campo) {
+    return (j->encontrados & (1u << campo)) ? j->valores[campo] : NULL;
+}
+
+static inline void json_anadir(struct json_extractor *j, char c) {
+    if (j->en_clave) {
+        if (j->clave_len < JSON_MAX_CLAVE) j->clave[j->clave_len++] = c;
+        else j->clave_larga = true;
+    } else if (j->campo >= 0) {
+        // Un id o un importe de más de JSON_MAX_VALOR bytes no es legítimo
+        if (j->valor_len[j->campo] == JSON_MAX_VALOR) j->error = true;
+        else j->valores[j->campo][j->valor_len[j->campo]++] = c;
+    }
+}
+
+static inline void json_fin_valor(struct json_extractor *j) {
+    if (j->campo >= 0) {
+        j->valores[j->campo][j->valor_len[j->campo]] = '\0';
+        j->encontrados |= 1u << j->campo;
+        j->campo = -1;
+    }
+    j->estado = j->profundidad ? JSON_TRAS_VALOR : JSON_FIN;
+}
+
+static inline bool json_clave_es(const struct json_extractor *j, const char *nombre) {
+    return !j->clave_larga && strlen(nombre) == j->clave_len && memcmp(nombre, j->clave, j->clave_len) == 0;
+}
+
+// Sólo cuentan las claves en su ubicación exacta. Un campo repetido invalida el
+// documento: con claves duplicadas cada parser se queda con un valor distinto.
+static inline void json_fin_clave(struct json_extractor *j) {
+    j->en_clave = false;
+    j->campo = -1;
+    if (j->profundidad == 1) j->clave_padre = false;
+    for (int i = 0; i < JSON_NUM_CAMPOS; i++) {
+        const struct json_ruta *r = &json_rutas[i];
+        if (j->profundidad == 1 && r->padre && json_clave_es(j, r->padre)) {
+            j->clave_padre = true;
+        }
+        bool en_su_sitio = r->padre ? (j->profundidad == 2 && j->es_padre[1]) : (j->profundidad == 1);
+        if (!en_su_sitio || !json_clave_es(j, r->nombre)) continue;
+        if (j->vistos & (1u << i)) {
+            j->error = true;
+            return;
+        }
+        j->vistos |= 1u << i;
+        j->campo = i;
+        j->valor_len[i] = 0;
+    }
+}
+
+static inline bool json_abrir(struct json_extractor *j, bool objeto) {
+    if (j->profundidad == JSON_MAX_PROFUNDIDAD) return false;
+    j->es_padre[j->profundidad] = objeto && j->profundidad == 1 && j->clave_padre;
+    j->es_objeto[j->profundidad++] = objeto;
+    j->campo = -1; // Los campos de interés son escalares
+    j->estado = objeto ? JSON_CLAVE_O_CIERRE : JSON_VALOR_O_CIERRE;
+    return true;
+}
+
+static inline bool json_cerrar(struct json_extractor *j, bool objeto) {
+    if (j->profundidad == 0 || j->es_objeto[j->profundidad - 1] != objeto) return false;
+    j->profundidad--;
+    json_fin_valor(j);
+    return true;
+}
+
+static inline bool json_es_espacio(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool json_es_digito(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Primer carácter de un número o de true/false/null
+static inline bool json_literal_empezar(struct json_extractor *j, char c) {
+    j->palabra = NULL;
+    if (c == '-') j->literal = JSON_NUM_SIGNO;
+    else if (c == '0') j->literal = JSON_NUM_CERO;
+    else if (json_es_digito(c)) j->literal = JSON_NUM_ENTERO;
+    else if (c == 't') j->palabra = "true";
+    else if (c == 'f') j->palabra = "false";
+    else if (c == 'n') j->palabra = "null";
+    else return false;
+    if (j->palabra) {
+        j->literal = JSON_PALABRA;
+        j->palabra_pos = 1;
+    }
+    return true;
+}
+
+// Acepta c como continuación del literal en curso; false si no le pertenece
+static inline bool json_literal_seguir(struct json_extractor *j, char c) {
+    switch (j->literal) {
+        case JSON_PALABRA:
+            if (j->palabra[j->palabra_pos] == '\0' || c != j->palabra[j->palabra_pos]) return false;
+            j->palabra_pos++;
+            return true;
+        case JSON_NUM_SIGNO:
+            if (!json_es_digito(c)) return false;
+            j->literal = (c == '0') ? JSON_NUM_CERO : JSON_NUM_ENTERO;
+            return true;
+        case JSON_NUM_ENTERO:
+            if (json_es_digito(c)) return true;
+            /* fall through */
+        case JSON_NUM_CERO:
+            if (c == '.') j->literal = JSON_NUM_PUNTO;
+            else if (c == 'e' || c == 'E') j->literal = JSON_NUM_EXP;
+            else return false;
+            return true;
+        case JSON_NUM_PUNTO:
+        case JSON_NUM_FRACCION:
+            if (json_es_digito(c)) {
+                j->literal = JSON_NUM_FRACCION;
+                return true;
+            }
+            if (j->literal == JSON_NUM_FRACCION && (c == 'e' || c == 'E')) {
+                j->literal = JSON_NUM_EXP;
+                return true;
+            }
+            return false;
+        case JSON_NUM_EXP:
+            if (c == '+' || c == '-') {
+                j->literal = JSON_NUM_EXP_SIGNO;
+                return true;
+            }
+            /* fall through */
+        case JSON_NUM_EXP_SIGNO:
+        case JSON_NUM_EXP_DIGITOS:
+            if (!json_es_digito(c)) return false;
+            j->literal = JSON_NUM_EXP_DIGITOS;
+            return true;
+    }
+    return false;
+}
+
+// El literal puede terminar aquí ("nul", "1." o "1e" no)
+static inline bool json_literal_completo(const struct json_extractor *j) {
+    switch (j->literal) {
+        case JSON_PALABRA:
+            return j->palabra[j->palabra_pos] == '\0';
+        case JSON_NUM_CERO:
+        case JSON_NUM_ENTERO:
+        case JSON_NUM_FRACCION:
+        case JSON_NUM_EXP_DIGITOS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Procesa un trozo del documento; devuelve false en cuanto es inválido
+static inline bool json_extractor_procesar(struct json_extractor *j, const char *datos, size_t n) {
+    for (size_t i = 0; i < n && !j->error; i++) {
+        char c = datos[i];
+        switch (j->estado) {
+            case JSON_VALOR_O_CIERRE:
+                if (c == ']') {
+                    j->error = !json_cerrar(j, false);
+                    break;
+                }
+                /* fall through */
+            case JSON_VALOR:
+                if (json_es_espacio(c)) break;
+                if (c == '{' || c == '[') {
+                    j->error = !json_abrir(j, c == '{');
+                } else if (c == '"') {
+                    j->en_clave = false;
+                    j->estado = JSON_CADENA;
+                } else if (json_literal_empezar(j, c)) {
+                    if (j->campo >= 0 && json_rutas[j->campo].solo_cadena) j->campo = -1;
+                    json_anadir(j, c);
+                    j->estado = JSON_LITERAL;
+                } else {
+                    j->error = true;
+                }
+                break;
+
+            case JSON_CLAVE_O_CIERRE:
+                if (c == '}') {
+                    j->error = !json_cerrar(j, true);
+                    break;
+                }
+                /* fall through */
+            case JSON_CLAVE:
+                if (json_es_espacio(c)) break;
+                if (c != '"') {
+                    j->error = true;
+                    break;
+                }
+                j->en_clave = true;
+                j->clave_len = 0;
+                j->clave_larga = false;
+                j->estado = JSON_CADENA;
+                break;
+
+            case JSON_DOS_PUNTOS:
+                if (json_es_espacio(c)) break;
+                if (c != ':') j->error = true;
+                else j->estado = JSON_VALOR;
+                break;
+
+            case JSON_CADENA:
+                if (c == '"') {
+                    if (j->en_clave) {
+                        json_fin_clave(j);
+                        j->estado = JSON_DOS_PUNTOS;
+                    } else {
+                        json_fin_valor(j);
+                    }
+                } else if (c == '\\') {
+                    j->estado = JSON_ESCAPE;
+                } else if ((unsigned char)c < 0x20) {
+                    j->error = true;
+                } else {
+                    json_anadir(j, c);
+                }
+                break;
+
+            case JSON_ESCAPE: {
+                const char *origen = "\"\\/bfnrt";
+                const char *destino = "\"\\/\b\f\n\r\t";
+                const char *p = (c != '\0') ? strchr(origen, c) : NULL;
+                if (p) {
+                    json_anadir(j, destino[p - origen]);
+                    j->estado = JSON_CADENA;
+                } else if (c == 'u') {
+                    j->unicode_restante = 4;
+                    j->estado = JSON_UNICODE;
+                } else {
+                    j->error = true;
+                }
+                break;
+            }
+
+            case JSON_UNICODE:
+                if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))) {
+                    j->error = true;
+                } else if (--j->unicode_restante == 0) {
+                    json_anadir(j, '?'); // Los campos de interés son ASCII
+                    j->estado = JSON_CADENA;
+                }
+                break;
+
+            case JSON_LITERAL:
+                if (json_literal_seguir(j, c)) {
+                    json_anadir(j, c);
+                    break;
+                }
+                if (!json_literal_completo(j)) {
+                    j->error = true;
+                    break;
+                }
+                json_fin_valor(j);
+                i--; // El carácter pertenece al siguiente token ("truefalse" falla ahí)
+                break;
+
+            case JSON_TRAS_VALOR:
+                if (json_es_espacio(c)) break;
+                if (c == ',') {
+                    j->estado = j->es_objeto[j->profundidad - 1] ? JSON_CLAVE : JSON_VALOR;
+                } else if (c == '}' || c == ']') {
+                    j->error = !json_cerrar(j, c == '}');
+                } else {
+                    j->error = true;
+                }
+                break;
+
+            case JSON_FIN:
+                if (!json_es_espacio(c)) j->error = true;
+                break;
+        }
+    }
+    return !j->error;
+}
+
+// Cierra el documento: true si era un JSON completo y bien formado
+static inline bool json_extractor_fin(struct json_extractor *j) {
+    if (!j->error && j->estado == JSON_LITERAL && j->profundidad == 0) {
+        if (!json_literal_completo(j)) return false;
+        json_fin_valor(j);
+    }
+    return !j->error && j->estado == JSON_FIN;
+}
+
+#endif
@@ -2,20 +2,446 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <arpa/inet.h>
+#include <sys/resource.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <zlib.h>
 
 #define PORT 8080
-#define MAX_CLIENTS 5
-#define BUFFER_SIZE 1024
+#define MAX_CLIENTS 512
+#define BUFFER_SIZE 16384  // Un registro TLS completo por lectura
+#define BACKLOG 128
+#define STATS_INTERVAL 10   // Segundos entre reportes de rendimiento
+#define SESSION_CACHE_SIZE 4096
+#define SESSION_TIMEOUT 300 // Segundos de validez de tickets/sesiones
+#define COMPRESS_THRESHOLD 512 // Bytes mínimos para comprimir un mensaje
+#define COMPRESS_CMD "/compress"
+#define FRAME_HEADER 5      // Tipo ('T' texto, 'Z' zlib) + longitud de 4 bytes
+#define BENCH_RECEPTORES 200 // Suscriptores simulados en --bench-compresion
+#define MAX_PENDIENTE (1024 * 1024) // Salida encolada máxima antes de expulsar a un cliente lento
 
-int main() {
-    int server_fd, client_fds[MAX_CLIENTS] = {0};
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t addr_len = sizeof(client_addr);
+// Estado de cada cliente dentro del bucle de eventos
+typedef struct {
+    int fd;
+    SSL *ssl;
+    int handshake_ok;
+    int compresion; // El cliente negoció mensajes enmarcados y comprimidos
+    // Salida pendiente: si SSL_write pide reintento se repite con los mismos bytes
+    unsigned char *salida;
+    size_t salida_len;
+    size_t salida_pos;
+    size_t salida_cap;
+} Cliente;
+
+// Mensaje preparado una sola vez y reutilizado para todos los destinatarios
+typedef struct {
+    unsigned char datos[FRAME_HEADER + BUFFER_SIZE + 64];
+    int len;
+    int listo;
+} Trama;
+
+// Contadores para medir handshakes/s y CPU por MB difundido
+typedef struct {
+    unsigned long handshakes;
+    unsigned long reanudados;
+    unsigned long long bytes_difundidos;
+    unsigned long long bytes_ahorrados;
+    unsigned long mensajes_comprimidos;
+    double cpu_compresion;
+    struct timespec inicio;
+    double cpu_inicio;
+} Estadisticas;
+
+static Cliente clientes[MAX_CLIENTS];
+static struct pollfd pfds[MAX_CLIENTS + 1];
+static Estadisticas stats;
+static int usar_ktls = 0;
+
+static double tiempo_cpu(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static void reiniciar_estadisticas(void) {
+    memset(&stats, 0, sizeof(stats));
+    clock_gettime(CLOCK_MONOTONIC, &stats.inicio);
+    stats.cpu_inicio = tiempo_cpu();
+}
+
+static void reportar_estadisticas(void) {
+    struct timespec ahora;
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    double segundos = (ahora.tv_sec - stats.inicio.tv_sec) +
+                      (ahora.tv_nsec - stats.inicio.tv_nsec) / 1e9;
+    if (segundos < STATS_INTERVAL) {
+        return;
+    }
+
+    double mb = stats.bytes_difundidos / (1024.0 * 1024.0);
+    double cpu = tiempo_cpu() - stats.cpu_inicio;
+    printf("[stats] handshakes/s: %.1f (reanudados: %lu/%lu), difundido: %.2f MB, "
+           "CPU por MB: %.3f ms, kTLS: %s\n",
+           stats.handshakes / segundos, stats.reanudados, stats.handshakes, mb,
+           mb > 0 ? cpu * 1000.0 / mb : 0.0, usar_ktls ? "si" : "no");
+    printf("[stats] compresión: %lu mensajes, %.2f MB ahorrados, CPU de compresión: %.3f ms\n",
+           stats.mensajes_comprimidos, stats.bytes_ahorrados / (1024.0 * 1024.0),
+           stats.cpu_compresion * 1000.0);
+    reiniciar_estadisticas();
+}
+
+static int poner_no_bloqueante(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Configura la caché de sesiones y los tickets para abaratar las reconexiones
+static void configurar_reanudacion(SSL_CTX *ctx) {
+    static const unsigned char sid_ctx[] = "caso26-chat";
+
+    SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT);
+    // Tickets sin estado en el servidor (TLS 1.2) y tickets de reanudación (TLS 1.3)
+    SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+    SSL_CTX_set_num_tickets(ctx, 2);
+
+#ifdef SSL_OP_ENABLE_KTLS
+    if (usar_ktls) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+#else
+    if (usar_ktls) {
+        fprintf(stderr, "kTLS no soportado por esta versión de OpenSSL\n");
+        usar_ktls = 0;
+    }
+#endif
+}
+
+static void cerrar_cliente(int idx) {
+    Cliente *c = &clientes[idx];
+    if (c->ssl) {
+        if (c->handshake_ok) {
+            SSL_shutdown(c->ssl);
+        }
+        SSL_free(c->ssl);
+    }
+    close(c->fd);
+    free(c->salida);
+    c->salida = NULL;
+    c->salida_len = c->salida_pos = c->salida_cap = 0;
+    c->fd = -1;
+    c->ssl = NULL;
+    c->handshake_ok = 0;
+    c->compresion = 0;
+    pfds[idx + 1].fd = -1;
+    pfds[idx + 1].events = 0;
+}
+
+// Ajusta los eventos de poll según lo que OpenSSL necesite para avanzar; con
+// salida pendiente se espera también a que el socket admita escritura
+static void esperar_evento(int idx, int err) {
+    short eventos = (err == SSL_ERROR_WANT_WRITE) ? POLLOUT : POLLIN;
+    if (clientes[idx].salida_pos < clientes[idx].salida_len) {
+        eventos |= POLLIN | POLLOUT;
+    }
+    pfds[idx + 1].events = eventos;
+}
+
+// Escribe la salida pendiente hasta vaciarla o hasta que el socket se llene.
+// Tras SSL_ERROR_WANT_WRITE el reintento usa exactamente los mismos bytes
+// pendientes, como exige OpenSSL
+static void vaciar_salida(int idx) {
+    Cliente *c = &clientes[idx];
+    while (c->salida_pos < c->salida_len) {
+        // Con kTLS activo, SSL_write cifra en el kernel sin copias en espacio de usuario
+        int ret = SSL_write(c->ssl, c->salida + c->salida_pos, (int)(c->salida_len - c->salida_pos));
+        if (ret > 0) {
+            c->salida_pos += (size_t)ret;
+            stats.bytes_difundidos += (unsigned long long)ret;
+            continue;
+        }
+        int err = SSL_get_error(c->ssl, ret);
+        if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) {
+            esperar_evento(idx, err);
+            return;
+        }
+        ERR_print_errors_fp(stderr);
+        cerrar_cliente(idx);
+        return;
+    }
+    c->salida_pos = c->salida_len = 0;
+    esperar_evento(idx, SSL_ERROR_NONE);
+}
+
+// Añade una copia del mensaje a la salida del cliente e intenta enviarla. Un
+// cliente que acumula más de MAX_PENDIENTE bytes sin leer se desconecta
+static void encolar(int idx, const void *datos, size_t len) {
+    Cliente *c = &clientes[idx];
+    if (c->salida_len - c->salida_pos + len > MAX_PENDIENTE) {
+        fprintf(stderr, "Cliente demasiado lento: se descarta la conexión\n");
+        cerrar_cliente(idx);
+        return;
+    }
+    if (c->salida_len + len > c->salida_cap) {
+        // Compactar mueve los bytes pendientes: permitido por SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+        memmove(c->salida, c->salida + c->salida_pos, c->salida_len - c->salida_pos);
+        c->salida_len -= c->salida_pos;
+        c->salida_pos = 0;
+        if (c->salida_len + len > c->salida_cap) {
+            size_t cap = c->salida_cap ? c->salida_cap : BUFFER_SIZE;
+            while (cap < c->salida_len + len) {
+                cap *= 2;
+            }
+            unsigned char *nueva = realloc(c->salida, cap);
+            if (!nueva) {
+                cerrar_cliente(idx);
+                return;
+            }
+            c->salida = nueva;
+            c->salida_cap = cap;
+        }
+    }
+    memcpy(c->salida + c->salida_len, datos, len);
+    c->salida_len += len;
+    vaciar_salida(idx);
+}
+
+// Avanza el handshake no bloqueante de un cliente
+static void continuar_handshake(int idx) {
+    Cliente *c = &clientes[idx];
+    int ret = SSL_accept(c->ssl);
+    if (ret == 1) {
+        c->handshake_ok = 1;
+        pfds[idx + 1].events = POLLIN;
+        stats.handshakes++;
+        if (SSL_session_reused(c->ssl)) {
+            stats.reanudados++;
+        }
+        printf("Nuevo cliente conectado (%s)\n",
+               SSL_session_reused(c->ssl) ? "sesión reanudada" : "handshake completo");
+        return;
+    }
+
+    int err = SSL_get_error(c->ssl, ret);
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+        esperar_evento(idx, err);
+        return;
+    }
+    ERR_print_errors_fp(stderr);
+    cerrar_cliente(idx);
+}
+
+static void aceptar_clientes(int server_fd, SSL_CTX *ctx) {
+    struct sockaddr_in client_addr;
+    socklen_t addr_len;
+
+    for (;;) {
+        addr_len = sizeof(client_addr);
+        int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &addr_len);
+        if (client_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("Error al aceptar conexión");
+            }
+            return;
+        }
+
+        int idx = -1;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (clientes[i].fd < 0) {
+                idx = i;
+                break;
+            }
+        }
+        if (idx < 0 || poner_no_bloqueante(client_fd) < 0) {
+            fprintf(stderr, "Conexión rechazada: límite de clientes alcanzado\n");
+            close(client_fd);
+            continue;
+        }
+
+        // Configurar SSL para el cliente
+        SSL *ssl = SSL_new(ctx);
+        if (!ssl) {
+            ERR_print_errors_fp(stderr);
+            close(client_fd);
+            continue;
+        }
+        SSL_set_fd(ssl, client_fd);
+        SSL_set_accept_state(ssl);
+
+        clientes[idx].fd = client_fd;
+        clientes[idx].ssl = ssl;
+        clientes[idx].handshake_ok = 0;
+        clientes[idx].compresion = 0;
+        pfds[idx + 1].fd = client_fd;
+        continuar_handshake(idx);
+    }
+}
+
+static double tiempo_cpu_hilo(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void escribir_cabecera(unsigned char *p, char tipo, int len) {
+    p[0] = (unsigned char)tipo;
+    p[1] = (unsigned char)(len >> 24);
+    p[2] = (unsigned char)(len >> 16);
+    p[3] = (unsigned char)(len >> 8);
+    p[4] = (unsigned char)len;
+}
+
+// Construye la trama para clientes con compresión: se comprime una sola vez por
+// mensaje y sólo si supera el umbral y realmente reduce el tamaño
+static void preparar_trama(Trama *t, const char *msg, int len) {
+    t->listo = 1;
+    if (len >= COMPRESS_THRESHOLD) {
+        double cpu = tiempo_cpu_hilo();
+        uLongf destino = sizeof(t->datos) - FRAME_HEADER;
+        int ret = compress2(t->datos + FRAME_HEADER, &destino,
+                            (const Bytef *)msg, (uLong)len, Z_BEST_SPEED);
+        stats.cpu_compresion += tiempo_cpu_hilo() - cpu;
+        if (ret == Z_OK && destino < (uLongf)len) {
+            escribir_cabecera(t->datos, 'Z', (int)destino);
+            t->len = FRAME_HEADER + (int)destino;
+            stats.mensajes_comprimidos++;
+            return;
+        }
+    }
+    escribir_cabecera(t->datos, 'T', len);
+    memcpy(t->datos + FRAME_HEADER, msg, (size_t)len);
+    t->len = FRAME_HEADER + len;
+}
+
+// Envía el mensaje a todos los clientes autenticados excepto al emisor. La
+// trama se comprime una vez y cada cliente recibe su propia copia en la cola,
+// así un reintento de SSL_write nunca ve un buffer reutilizado por otro mensaje
+static void difundir(int origen, const char *msg, int len) {
+    Trama trama;
+    trama.listo = 0;
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (i == origen || clientes[i].fd < 0 || !clientes[i].handshake_ok) {
+            continue;
+        }
+        const void *datos = msg;
+        int total = len;
+        if (clientes[i].compresion) {
+            if (!trama.listo) {
+                preparar_trama(&trama, msg, len);
+            }
+            datos = trama.datos;
+            total = trama.len;
+        }
+        if (clientes[i].compresion && total < len) {
+            stats.bytes_ahorrados += (unsigned long long)(len - total);
+        }
+        encolar(i, datos, (size_t)total);
+    }
+}
+
+// Benchmark sin red: difunde mensajes de prueba de distintos tamaños a
+// BENCH_RECEPTORES suscriptores con compresión y compara el ancho de banda
+// ahorrado con la CPU gastada en comprimir
+static int bench_compresion(int mensajes) {
+    static const char frase[] = "ERROR 2024-05-12 10:31:07 pedido=48213 estado=pendiente "
+                                "reintento en 30s (timeout al contactar con pagos)\n";
+    static const int tamanos[] = {200, 800, 4000, BUFFER_SIZE - 1};
+    char msg[BUFFER_SIZE];
+    unsigned long long original = 0, enviado = 0;
+    Trama trama;
+
+    memset(&stats, 0, sizeof(stats));
+    srand(26);
+    for (int m = 0; m < mensajes; m++) {
+        int len = tamanos[m % 4];
+        // Texto repetitivo como un log pegado, con algo de ruido para no ser trivial
+        for (int i = 0; i < len; i++) {
+            msg[i] = (rand() % 16 == 0) ? (char)('a' + rand() % 26) : frase[i % (sizeof(frase) - 1)];
+        }
+        trama.listo = 0;
+        preparar_trama(&trama, msg, len);
+        original += (unsigned long long)(FRAME_HEADER + len);
+        enviado += (unsigned long long)trama.len;
+    }
+
+    double mb_ahorrados = (double)(original - enviado) * BENCH_RECEPTORES / (1024.0 * 1024.0);
+    printf("mensajes: %d (%lu comprimidos), receptores: %d\n", mensajes,
+           stats.mensajes_comprimidos, BENCH_RECEPTORES);
+    printf("bytes por receptor: %llu -> %llu (%.1f%% menos)\n", original, enviado,
+           original ? 100.0 * (double)(original - enviado) / (double)original : 0.0);
+    printf("ancho de banda ahorrado: %.2f MB, CPU de compresión: %.3f ms (%.3f ms por MB ahorrado)\n",
+           mb_ahorrados, stats.cpu_compresion * 1000.0,
+           mb_ahorrados > 0 ? stats.cpu_compresion * 1000.0 / mb_ahorrados : 0.0);
+    return EXIT_SUCCESS;
+}
+
+static void leer_cliente(int idx) {
+    Cliente *c = &clientes[idx];
     char buffer[BUFFER_SIZE];
 
+    // Recibir mensaje con límites seguros
+    int read_bytes = SSL_read(c->ssl, buffer, BUFFER_SIZE - 1);
+    if (read_bytes <= 0) {
+        int err = SSL_get_error(c->ssl, read_bytes);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+            esperar_evento(idx, err);
+            return;
+        }
+        printf("Cliente desconectado\n");
+        cerrar_cliente(idx);
+        return;
+    }
+    esperar_evento(idx, SSL_ERROR_NONE);
+
+    buffer[read_bytes] = '\0'; // Asegurar terminación
+    printf("Mensaje recibido: %s\n", buffer);
+
+    // Negociación de compresión por cliente
+    if (strncmp(buffer, COMPRESS_CMD, strlen(COMPRESS_CMD)) == 0 &&
+        strspn(buffer + strlen(COMPRESS_CMD), "\r\n") == strlen(buffer + strlen(COMPRESS_CMD))) {
+        static const char ok[] = "OK compress zlib\n";
+        c->compresion = 1;
+        encolar(idx, ok, sizeof(ok) - 1);
+        return;
+    }
+
+    // Validar entrada (ejemplo: no aceptar comandos maliciosos)
+    if (strstr(buffer, "malicious") != NULL) {
+        printf("Mensaje bloqueado por contener contenido no permitido.\n");
+        return;
+    }
+    // Difundir mensaje a otros clientes
+    difundir(idx, buffer, read_bytes);
+}
+
+int main(int argc, char *argv[]) {
+    int server_fd;
+    struct sockaddr_in server_addr;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ktls") == 0) {
+            usar_ktls = 1;
+        } else if (strcmp(argv[i], "--bench-compresion") == 0) {
+            int mensajes = (i + 1 < argc) ? atoi(argv[i + 1]) : 0;
+            return bench_compresion(mensajes > 0 ? mensajes : 10000);
+        } else {
+            fprintf(stderr, "Uso: %s [--ktls] [--bench-compresion [mensajes]]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
     // Crear contexto SSL
     SSL_library_init();
     OpenSSL_add_all_algorithms();
@@ -32,6 +458,10 @@ int main() {
         ERR_print_errors_fp(stderr);
         exit(EXIT_FAILURE);
     }
+    configurar_reanudacion(ctx);
+    // Los reintentos de SSL_write se hacen desde la cola de cada cliente, que
+    // puede haberse movido al crecer, y cada registro enviado cuenta como avance
+    SSL_CTX_set_mode(ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_ENABLE_PARTIAL_WRITE);
 
     // Crear socket
     server_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -40,6 +470,10 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
     server_addr.sin_port = htons(PORT);
@@ -52,58 +486,68 @@ int main() {
     }
 
     // Escuchar conexiones
-    if (listen(server_fd, MAX_CLIENTS) < 0) {
+    if (listen(server_fd, BACKLOG) < 0 || poner_no_bloqueante(server_fd) < 0) {
         perror("Error en listen");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
     printf("Servidor seguro iniciado en el puerto %d\n", PORT);
 
+    // Inicializar tabla de clientes y descriptores de poll
+    pfds[0].fd = server_fd;
+    pfds[0].events = POLLIN;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        clientes[i].fd = -1;
+        clientes[i].salida = NULL;
+        pfds[i + 1].fd = -1;
+    }
+    reiniciar_estadisticas();
+
     while (1) {
-        // Aceptar nueva conexión
-        int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &addr_len);
-        if (client_fd < 0) {
-            perror("Error al aceptar conexión");
-            continue;
+        int listos = poll(pfds, MAX_CLIENTS + 1, 1000);
+        if (listos < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error en poll");
+            break;
         }
 
-        // Configurar SSL para el cliente
-        SSL *ssl = SSL_new(ctx);
-        SSL_set_fd(ssl, client_fd);
-        if (SSL_accept(ssl) <= 0) {
-            ERR_print_errors_fp(stderr);
-            close(client_fd);
-            SSL_free(ssl);
-            continue;
+        if (pfds[0].revents & POLLIN) {
+            aceptar_clientes(server_fd, ctx);
         }
-        printf("Nuevo cliente conectado\n");
 
-        // Recibir mensaje con límites seguros
-        int read_bytes = SSL_read(ssl, buffer, BUFFER_SIZE - 1);
-        if (read_bytes > 0) {
-            buffer[read_bytes] = '\0'; // Asegurar terminación
-            printf("Mensaje recibido: %s\n", buffer);
-
-            // Validar entrada (ejemplo: no aceptar comandos maliciosos)
-            if (strstr(buffer, "malicious") != NULL) {
-                printf("Mensaje bloqueado por contener contenido no permitido.\n");
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            short rev = pfds[i + 1].revents;
+            if (clientes[i].fd < 0 || rev == 0) {
+                continue;
+            }
+            if (rev & (POLLERR | POLLNVAL)) {
+                cerrar_cliente(i);
+            } else if (!clientes[i].handshake_ok) {
+                continuar_handshake(i);
             } else {
-                // Difundir mensaje a otros clientes
-                for (int i = 0; i < MAX_CLIENTS; i++) {
-                    if (client_fds[i] > 0 && client_fds[i] != client_fd) {
-                        SSL_write(ssl, buffer, strlen(buffer));
+                if (clientes[i].salida_pos < clientes[i].salida_len) {
+                    vaciar_salida(i);
+                }
+                // Vaciar también los registros TLS ya descifrados en el buffer de OpenSSL
+                while (clientes[i].fd >= 0) {
+                    leer_cliente(i);
+                    if (clientes[i].fd < 0 || SSL_pending(clientes[i].ssl) == 0) {
+                        break;
                     }
                 }
             }
         }
-
-        // Cerrar conexión
-        SSL_shutdown(ssl);
-        close(client_fd);
-        SSL_free(ssl);
+        reportar_estadisticas();
     }
 
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clientes[i].fd >= 0) {
+            cerrar_cliente(i);
+        }
+    }
     close(server_fd);
     SSL_CTX_free(ctx);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,458 @@
+// Banco de carga para los tres servidores de login de caso5.
+//
+//   bench_login <seek|copilot|chatgpt> <binario> [--clientes N] [--peticiones N]
+//               [--validos PCT] [--usuario U] [--password P] [--formato json|csv]
+//               [--limitador si|no]
+//
+// Prepara la base de datos sustituta de cada implementación (users.db de SQLite
+// para chatgpt, variables DB_USERNAME/DB_PASSWORD para copilot; seek usa la
+// instancia local de PostgreSQL con el usuario indicado ya dado de alta),
+// arranca el servidor en un directorio temporal, lanza la mezcla de logins
+// válidos/inválidos y emite peticiones/s y percentiles de latencia.
+//
+// Todos los clientes salen de 127.0.0.1, así que los límites por IP de los
+// servidores medirían rechazos y no logins: seek se arranca con --per-ip 0 y
+// chatgpt con --max-attempts 0 (tras 5 fallos respondería 429 a todo). Con
+// --limitador si se conservan sus valores por defecto para medir ese camino.
+//
+// copilot (copilotcaso2.c) no puede medirse tal cual: arranca microhttpd con
+// MHD_USE_TLS sin MHD_OPTION_HTTPS_MEM_KEY/CERT, así que MHD_start_daemon
+// falla y el proceso termina; además lee el formulario con
+// MHD_lookup_connection_value sin MHD_PostProcessor y respondería 400 a todo.
+// El banco lo detecta y lo indica en lugar de publicar cifras.
+//
+// gcc bench_login.c -o bench_login -lssl -lcrypto -lsqlite3 -lpthread
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/wait.h>
+#include <sqlite3.h>
+#include <openssl/ssl.h>
+#include <openssl/sha.h>
+
+#define PORT 8080
+#define MAX_CLIENTES 256
+#define ARRANQUE_MS 10000
+#define RESPUESTA_MAX 8192
+
+enum servidor { SRV_SEEK, SRV_COPILOT, SRV_CHATGPT };
+
+struct config {
+    enum servidor tipo;
+    const char *nombre;
+    const char *binario;
+    int clientes;
+    int peticiones;
+    int pct_validos;
+    const char *usuario;
+    const char *password;
+    int csv;
+    int tls;
+    int limitador;     // Mantener los límites por IP de los servidores
+};
+
+// Resultado de un cliente: latencias en ms y contadores por clase de respuesta
+struct resultado {
+    const struct config *cfg;
+    unsigned int semilla;
+    double *latencias;
+    int n;
+    int correctas;     // El resultado del login coincide con lo esperado
+    int incorrectas;
+    int limitadas;     // 429 del limitador de intentos
+    int errores;       // Conexión o respuesta ilegible
+};
+
+static SSL_CTX *ssl_ctx;
+
+static double ms_desde(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+static int conectar(void) {
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(PORT)};
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Envía la petición y lee la respuesta completa (el servidor cierra la conexión)
+static int peticion(const struct config *cfg, const char *req, int req_len, char *resp) {
+    int fd = conectar();
+    if (fd < 0) {
+        return -1;
+    }
+
+    int total = 0, n;
+    SSL *ssl = NULL;
+    if (cfg->tls) {
+        ssl = SSL_new(ssl_ctx);
+        SSL_set_fd(ssl, fd);
+        if (SSL_connect(ssl) != 1 || SSL_write(ssl, req, req_len) != req_len) {
+            SSL_free(ssl);
+            close(fd);
+            return -1;
+        }
+        while (total < RESPUESTA_MAX - 1 &&
+               (n = SSL_read(ssl, resp + total, RESPUESTA_MAX - 1 - total)) > 0) {
+            total += n;
+        }
+        SSL_free(ssl);
+    } else {
+        if (write(fd, req, (size_t)req_len) != req_len) {
+            close(fd);
+            return -1;
+        }
+        while (total < RESPUESTA_MAX - 1 &&
+               (n = (int)read(fd, resp + total, (size_t)(RESPUESTA_MAX - 1 - total))) > 0) {
+            total += n;
+        }
+    }
+    close(fd);
+    resp[total] = '\0';
+    return total;
+}
+
+static void *cliente(void *arg) {
+    struct resultado *r = arg;
+    const struct config *cfg = r->cfg;
+    char cuerpo[256], req[512], resp[RESPUESTA_MAX];
+
+    for (int i = 0; i < cfg->peticiones; i++) {
+        int valido = (int)(rand_r(&r->semilla) % 100) < cfg->pct_validos;
+        int cuerpo_len = snprintf(cuerpo, sizeof(cuerpo), "username=%s&password=%s",
+                                  cfg->usuario, valido ? cfg->password : "incorrecta");
+        int req_len = snprintf(req, sizeof(req),
+                               "POST /login HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n"
+                               "Content-Type: application/x-www-form-urlencoded\r\n"
+                               "Content-Length: %d\r\n\r\n%s", cuerpo_len, cuerpo);
+
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        int n = peticion(cfg, req, req_len, resp);
+        r->latencias[r->n++] = ms_desde(&t0);
+
+        if (n <= 0 || strncmp(resp, "HTTP/1.", 7) != 0) {
+            r->errores++;
+        } else if (strncmp(resp + 9, "429", 3) == 0) {
+            r->limitadas++;
+        } else if ((strstr(resp, "Login exitoso") != NULL) == valido) {
+            r->correctas++;
+        } else {
+            r->incorrectas++;
+        }
+    }
+    return NULL;
+}
+
+// Base de datos sustituta para chatgptcaso2.c: users.db con el usuario de prueba
+static int preparar_sqlite(const struct config *cfg) {
+    sqlite3 *db;
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    char hash_hex[SHA256_DIGEST_LENGTH * 2 + 1];
+    sqlite3_stmt *stmt;
+
+    SHA256((const unsigned char *)cfg->password, strlen(cfg->password), hash);
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        snprintf(hash_hex + i * 2, 3, "%02x", hash[i]);
+    }
+
+    if (sqlite3_open("users.db", &db) != SQLITE_OK ||
+        sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS users (username TEXT PRIMARY KEY, password TEXT);",
+                     NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO users VALUES (?, ?)", -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Error al preparar users.db: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, cfg->usuario, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, hash_hex, -1, SQLITE_STATIC);
+    int ok = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return ok;
+}
+
+// Arranca el servidor con stdin en una tubería: al cerrarla, getchar() devuelve EOF y termina
+static pid_t arrancar_servidor(const struct config *cfg, int *stdin_fd) {
+    int tubo[2];
+    if (pipe(tubo) < 0) {
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(tubo[0], STDIN_FILENO);
+        close(tubo[0]);
+        close(tubo[1]);
+        if (cfg->tipo == SRV_COPILOT) {
+            setenv("DB_USERNAME", cfg->usuario, 1);
+            setenv("DB_PASSWORD", cfg->password, 1);
+        }
+        if (cfg->tipo == SRV_SEEK && !cfg->limitador) {
+            execl(cfg->binario, cfg->binario, "--per-ip", "0", (char *)NULL);
+        } else if (cfg->tipo == SRV_CHATGPT && !cfg->limitador) {
+            execl(cfg->binario, cfg->binario, "--max-attempts", "0", (char *)NULL);
+        } else {
+            execl(cfg->binario, cfg->binario, (char *)NULL);
+        }
+        perror("execl");
+        _exit(127);
+    }
+    close(tubo[0]);
+    *stdin_fd = tubo[1];
+    if (pid < 0) {
+        close(tubo[1]);
+        return -1;
+    }
+
+    // Esperar a que el puerto acepte conexiones
+    struct timespec t0;
+    int estado;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (ms_desde(&t0) < ARRANQUE_MS) {
+        int fd = conectar();
+        if (fd >= 0) {
+            close(fd);
+            return pid;
+        }
+        if (waitpid(pid, &estado, WNOHANG) == pid) {
+            fprintf(stderr, "El servidor %s terminó al arrancar (código %d)\n", cfg->nombre,
+                    WIFEXITED(estado) ? WEXITSTATUS(estado) : -1);
+            if (cfg->tipo == SRV_COPILOT) {
+                fprintf(stderr, "copilotcaso2.c activa MHD_USE_TLS sin clave ni certificado: "
+                                "no hay resultados que medir para este servidor\n");
+            }
+            close(*stdin_fd);
+            return -1;
+        }
+        usleep(50000);
+    }
+    fprintf(stderr, "El servidor %s no llegó a escuchar en el puerto %d\n", cfg->nombre, PORT);
+    close(*stdin_fd);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+static void parar_servidor(pid_t pid, int stdin_fd) {
+    close(stdin_fd);
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (waitpid(pid, NULL, WNOHANG) == 0) {
+        if (ms_desde(&t0) > 2000) {
+            kill(pid, SIGTERM);
+            waitpid(pid, NULL, 0);
+            return;
+        }
+        usleep(20000);
+    }
+}
+
+static int comparar_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentil(const double *v, int n, int p) {
+    int idx = (int)((long)n * p / 100);
+    return v[idx < n ? idx : n - 1];
+}
+
+static void informar(const struct config *cfg, struct resultado *res, double ms_total) {
+    int n = 0, correctas = 0, incorrectas = 0, limitadas = 0, errores = 0;
+    for (int i = 0; i < cfg->clientes; i++) {
+        n += res[i].n;
+        correctas += res[i].correctas;
+        incorrectas += res[i].incorrectas;
+        limitadas += res[i].limitadas;
+        errores += res[i].errores;
+    }
+
+    double *todas = malloc((size_t)n * sizeof(double));
+    if (!todas || n == 0) {
+        free(todas);
+        return;
+    }
+    for (int i = 0, k = 0; i < cfg->clientes; i++) {
+        memcpy(todas + k, res[i].latencias, (size_t)res[i].n * sizeof(double));
+        k += res[i].n;
+    }
+    qsort(todas, (size_t)n, sizeof(double), comparar_double);
+
+    double rps = n * 1000.0 / ms_total;
+    if (cfg->csv) {
+        printf("servidor,clientes,peticiones,pct_validos,rps,p50_ms,p90_ms,p99_ms,max_ms,"
+               "correctas,incorrectas,limitadas,errores\n");
+        printf("%s,%d,%d,%d,%.1f,%.3f,%.3f,%.3f,%.3f,%d,%d,%d,%d\n",
+               cfg->nombre, cfg->clientes, n, cfg->pct_validos, rps,
+               percentil(todas, n, 50), percentil(todas, n, 90), percentil(todas, n, 99),
+               todas[n - 1], correctas, incorrectas, limitadas, errores);
+    } else {
+        printf("{\"servidor\":\"%s\",\"clientes\":%d,\"peticiones\":%d,\"pct_validos\":%d,"
+               "\"rps\":%.1f,\"latencia_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f},"
+               "\"correctas\":%d,\"incorrectas\":%d,\"limitadas\":%d,\"errores\":%d}\n",
+               cfg->nombre, cfg->clientes, n, cfg->pct_validos, rps,
+               percentil(todas, n, 50), percentil(todas, n, 90), percentil(todas, n, 99),
+               todas[n - 1], correctas, incorrectas, limitadas, errores);
+    }
+    free(todas);
+}
+
+static void uso(const char *prog) {
+    fprintf(stderr,
+            "Uso: %s <seek|copilot|chatgpt> <binario> [--clientes N] [--peticiones N]\n"
+            "          [--validos PCT] [--usuario U] [--password P] [--formato json|csv]\n"
+            "          [--limitador si|no]\n", prog);
+}
+
+// Directorio de trabajo de esta ejecución; se borra al salir por cualquier camino
+static char dir_trabajo[] = "/tmp/bench_login_XXXXXX";
+static char dir_origen[4096];
+
+// Vacía el directorio temporal (enlaces a los certificados, users.db y sus
+// ficheros -wal/-shm, lo que haya dejado el servidor) y lo elimina
+static void borrar_dir_trabajo(void) {
+    DIR *d = opendir(dir_trabajo);
+    if (d) {
+        struct dirent *e;
+        while ((e = readdir(d)) != NULL) {
+            if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+            if (unlinkat(dirfd(d), e->d_name, 0) < 0) perror(e->d_name);
+        }
+        closedir(d);
+    }
+    if (chdir(dir_origen) < 0 || rmdir(dir_trabajo) < 0) {
+        perror(dir_trabajo);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    struct config cfg = {
+        .clientes = 8,
+        .peticiones = 200,
+        .pct_validos = 50,
+        .usuario = "bench",
+        .password = "bench-pass"
+    };
+
+    if (argc < 3) {
+        uso(argv[0]);
+        return 1;
+    }
+    cfg.nombre = argv[1];
+    if (strcmp(argv[1], "seek") == 0) {
+        cfg.tipo = SRV_SEEK;
+        cfg.tls = 1;
+    } else if (strcmp(argv[1], "copilot") == 0) {
+        cfg.tipo = SRV_COPILOT;
+        cfg.tls = 1;
+    } else if (strcmp(argv[1], "chatgpt") == 0) {
+        cfg.tipo = SRV_CHATGPT;
+    } else {
+        uso(argv[0]);
+        return 1;
+    }
+
+    char *binario = realpath(argv[2], NULL);
+    if (!binario) {
+        perror(argv[2]);
+        return 1;
+    }
+    cfg.binario = binario;
+
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--clientes") == 0) {
+            cfg.clientes = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--peticiones") == 0) {
+            cfg.peticiones = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--validos") == 0) {
+            cfg.pct_validos = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--usuario") == 0) {
+            cfg.usuario = argv[i + 1];
+        } else if (strcmp(argv[i], "--password") == 0) {
+            cfg.password = argv[i + 1];
+        } else if (strcmp(argv[i], "--formato") == 0) {
+            cfg.csv = strcmp(argv[i + 1], "csv") == 0;
+        } else if (strcmp(argv[i], "--limitador") == 0) {
+            cfg.limitador = strcmp(argv[i + 1], "si") == 0;
+        } else {
+            uso(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.clientes < 1 || cfg.clientes > MAX_CLIENTES || cfg.peticiones < 1 ||
+        cfg.pct_validos < 0 || cfg.pct_validos > 100) {
+        uso(argv[0]);
+        return 1;
+    }
+
+    // Cada ejecución trabaja en un directorio temporal propio (users.db, certificados)
+    if (!getcwd(dir_origen, sizeof(dir_origen)) || !mkdtemp(dir_trabajo)) {
+        perror("Error al crear el directorio de trabajo");
+        return 1;
+    }
+    atexit(borrar_dir_trabajo);
+    if (chdir(dir_trabajo) < 0) {
+        perror(dir_trabajo);
+        return 1;
+    }
+    if (cfg.tls) {
+        // Los servidores TLS leen server.key/server.crt del directorio actual
+        char origen[4200];
+        snprintf(origen, sizeof(origen), "%s/server.key", dir_origen);
+        if (symlink(origen, "server.key") < 0) perror("server.key");
+        snprintf(origen, sizeof(origen), "%s/server.crt", dir_origen);
+        if (symlink(origen, "server.crt") < 0) perror("server.crt");
+    }
+    if (cfg.tipo == SRV_CHATGPT && !preparar_sqlite(&cfg)) {
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    ssl_ctx = SSL_CTX_new(TLS_client_method());
+
+    int stdin_fd;
+    pid_t pid = arrancar_servidor(&cfg, &stdin_fd);
+    if (pid < 0) {
+        return 1;
+    }
+
+    pthread_t tids[MAX_CLIENTES];
+    struct resultado res[MAX_CLIENTES];
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < cfg.clientes; i++) {
+        res[i] = (struct resultado){.cfg = &cfg, .semilla = (unsigned int)i + 1};
+        res[i].latencias = calloc((size_t)cfg.peticiones, sizeof(double));
+        pthread_create(&tids[i], NULL, cliente, &res[i]);
+    }
+    for (int i = 0; i < cfg.clientes; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    double ms_total = ms_desde(&t0);
+
+    parar_servidor(pid, stdin_fd);
+    informar(&cfg, res, ms_total);
+
+    for (int i = 0; i < cfg.clientes; i++) {
+        free(res[i].latencias);
+    }
+    SSL_CTX_free(ssl_ctx);
+    free(binario);
+    return 0;
+}
@@ -2,20 +2,56 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
 #include <sqlite3.h>
 #include <openssl/sha.h>
+#include "form_parser.h"
+#include "session_store.h"
 
 #define MAX_ATTEMPTS 5
+#define FAILED_WINDOW_SECS 900   // Los intentos fallidos caducan tras 15 minutos
+#define RL_SHARDS 64
+#define RL_SLOTS_PER_SHARD 4096  // 262144 IPs como máximo, memoria fija
+#define RL_PROBE 8               // Ranuras candidatas por IP (búsqueda y desalojo LRU)
+#define MAX_BODY_LEN 4096
+#define READ_CHUNK 512
+#define DB_PATH "users.db"
+#define DB_BUSY_TIMEOUT_MS 5000
 
 sqlite3 *db;
 
+// Conexión y sentencia preparadas una sola vez por hilo de civetweb
 typedef struct {
-    char ip[64];
-    int attempts;
+    sqlite3 *db;
+    sqlite3_stmt *check_stmt;
+} ThreadDB;
+
+static pthread_key_t thread_db_key;
+
+// Entrada de la tabla de intentos fallidos. Etiqueta de la IP, contador y
+// último intento van en una sola palabra que se cambia con un único CAS, así
+// ningún hilo ve ni modifica una ranura a medio reclamar por otra IP:
+//   bits 63..32 etiqueta (0 = libre), 31..24 intentos, 23..0 último intento (s)
+typedef struct {
+    _Atomic uint64_t state;
 } LoginAttempt;
 
-LoginAttempt failed_logins[100];
-int failed_logins_count = 0;
+#define RL_TAG(s) ((uint32_t)((s) >> 32))
+#define RL_ATTEMPTS(s) ((uint32_t)((s) >> 24) & 0xff)
+#define RL_SEEN(s) ((uint32_t)(s) & 0xffffff)
+#define RL_PACK(tag, attempts, seen) \
+    (((uint64_t)(tag) << 32) | ((uint64_t)(attempts) << 24) | ((seen) & 0xffffff))
+
+typedef struct {
+    LoginAttempt slots[RL_SLOTS_PER_SHARD];
+} __attribute__((aligned(64))) LoginShard;
+
+static LoginShard failed_logins[RL_SHARDS];
+static int max_attempts = MAX_ATTEMPTS; // 0 desactiva el limitador (--max-attempts)
 
 void sha256_hash(const char *input, char *output_hex) {
     unsigned char hash[SHA256_DIGEST_LENGTH];
@@ -32,26 +68,78 @@ void init_database() {
                              "username TEXT PRIMARY KEY, "
                              "password TEXT);";
 
-    if (sqlite3_open("users.db", &db)) {
+    if (sqlite3_open(DB_PATH, &db)) {
         fprintf(stderr, "Can't open DB: %s\n", sqlite3_errmsg(db));
         exit(1);
     }
 
+    // WAL permite lectores concurrentes desde las conexiones de cada hilo
+    if (sqlite3_exec(db, "PRAGMA journal_mode=WAL;", 0, 0, &err_msg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        err_msg = NULL;
+    }
+
     if (sqlite3_exec(db, sql_create, 0, 0, &err_msg) != SQLITE_OK) {
         fprintf(stderr, "SQL error: %s\n", err_msg);
         sqlite3_free(err_msg);
     }
 }
 
+static void close_thread_db(void *ptr) {
+    ThreadDB *tdb = ptr;
+    sqlite3_finalize(tdb->check_stmt);
+    sqlite3_close(tdb->db);
+    free(tdb);
+}
+
+void init_thread_db_key() {
+    if (pthread_key_create(&thread_db_key, close_thread_db) != 0) {
+        fprintf(stderr, "Can't create thread DB key\n");
+        exit(1);
+    }
+}
+
+// Abre (la primera vez) la conexión propia del hilo actual
+static ThreadDB *get_thread_db() {
+    ThreadDB *tdb = pthread_getspecific(thread_db_key);
+    if (tdb) {
+        return tdb;
+    }
+
+    tdb = calloc(1, sizeof(ThreadDB));
+    if (!tdb) {
+        return NULL;
+    }
+
+    const char *sql = "SELECT 1 FROM users WHERE username=? AND password=?";
+    if (sqlite3_open_v2(DB_PATH, &tdb->db,
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK ||
+        sqlite3_busy_timeout(tdb->db, DB_BUSY_TIMEOUT_MS) != SQLITE_OK ||
+        sqlite3_prepare_v3(tdb->db, sql, -1, SQLITE_PREPARE_PERSISTENT,
+                           &tdb->check_stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Can't open thread DB: %s\n", sqlite3_errmsg(tdb->db));
+        sqlite3_close(tdb->db);
+        free(tdb);
+        return NULL;
+    }
+
+    pthread_setspecific(thread_db_key, tdb);
+    return tdb;
+}
+
 int check_credentials(const char *username, const char *password) {
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT * FROM users WHERE username=? AND password=?";
     int found = 0;
     char hashed_password[65];
+    ThreadDB *tdb = get_thread_db();
+
+    if (!tdb) {
+        return 0;
+    }
 
     sha256_hash(password, hashed_password);
 
-    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    sqlite3_stmt *stmt = tdb->check_stmt;
     sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 2, hashed_password, -1, SQLITE_STATIC);
 
@@ -59,28 +147,160 @@ int check_credentials(const char *username, const char *password) {
         found = 1;
     }
 
-    sqlite3_finalize(stmt);
+    // Reutilizar la sentencia en la siguiente petición de este hilo
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
     return found;
 }
 
+static uint32_t now_secs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec;
+}
+
+// Convierte la IP textual a 16 bytes (IPv4 como IPv6 mapeada) y la resume en 64 bits
+static uint64_t ip_key(const char *ip) {
+    unsigned char addr[16] = {0};
+    struct in_addr v4;
+
+    if (inet_pton(AF_INET, ip, &v4) == 1) {
+        addr[10] = 0xff;
+        addr[11] = 0xff;
+        memcpy(addr + 12, &v4, 4);
+    } else if (inet_pton(AF_INET6, ip, addr) != 1) {
+        strncpy((char *)addr, ip, sizeof(addr));
+    }
+
+    uint64_t h = 1469598103934665603ULL; // FNV-1a
+    for (int i = 0; i < 16; i++) {
+        h ^= addr[i];
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+static LoginAttempt *probe_slot(uint64_t key, int i) {
+    LoginShard *shard = &failed_logins[key >> 58];
+    return &shard->slots[(key + (uint64_t)i) & (RL_SLOTS_PER_SHARD - 1)];
+}
+
+// La etiqueta usa bits del hash distintos de los que eligen shard y ranura
+static uint32_t ip_tag(uint64_t key) {
+    uint32_t tag = (uint32_t)(key >> 26);
+    return tag ? tag : 1;
+}
+
+// Segundos desde el último intento; el reloj de la ranura es de 24 bits (194 días)
+static uint32_t slot_age(uint32_t now, uint64_t state) {
+    return (now - RL_SEEN(state)) & 0xffffff;
+}
+
 int get_failed_attempts(const char *ip) {
-    for (int i = 0; i < failed_logins_count; i++) {
-        if (strcmp(failed_logins[i].ip, ip) == 0)
-            return failed_logins[i].attempts;
+    uint64_t key = ip_key(ip);
+    uint32_t tag = ip_tag(key);
+    uint32_t now = now_secs();
+
+    for (int i = 0; i < RL_PROBE; i++) {
+        uint64_t state = atomic_load_explicit(&probe_slot(key, i)->state, memory_order_acquire);
+        if (RL_TAG(state) == tag) {
+            return slot_age(now, state) > FAILED_WINDOW_SECS ? 0 : (int)RL_ATTEMPTS(state);
+        }
     }
     return 0;
 }
 
 void increment_failed_attempts(const char *ip) {
-    for (int i = 0; i < failed_logins_count; i++) {
-        if (strcmp(failed_logins[i].ip, ip) == 0) {
-            failed_logins[i].attempts++;
+    uint64_t key = ip_key(ip);
+    uint32_t tag = ip_tag(key);
+    uint32_t now = now_secs();
+
+    for (;;) {
+        // Reclamar una ranura libre o desalojar la usada hace más tiempo, salvo
+        // que la IP ya tenga la suya
+        LoginAttempt *slot = NULL;
+        uint64_t expected = 0;
+        uint64_t desired = RL_PACK(tag, 1, now);
+        uint32_t oldest_age = 0;
+        for (int i = 0; i < RL_PROBE; i++) {
+            LoginAttempt *cand = probe_slot(key, i);
+            uint64_t state = atomic_load_explicit(&cand->state, memory_order_acquire);
+            if (RL_TAG(state) == tag) {
+                uint32_t attempts = RL_ATTEMPTS(state);
+                if (slot_age(now, state) > FAILED_WINDOW_SECS) {
+                    attempts = 1;
+                } else if (attempts < 0xff) {
+                    attempts++;
+                }
+                slot = cand;
+                expected = state;
+                desired = RL_PACK(tag, attempts, now);
+                break;
+            }
+            uint32_t age = RL_TAG(state) ? slot_age(now, state) : UINT32_MAX;
+            if (!slot || age > oldest_age) {
+                slot = cand;
+                expected = state;
+                oldest_age = age;
+            }
+        }
+
+        if (atomic_compare_exchange_strong_explicit(&slot->state, &expected, desired,
+                                                    memory_order_acq_rel,
+                                                    memory_order_acquire)) {
             return;
         }
+        // Otro hilo cambió la ranura entre la lectura y el CAS: reintentar
+    }
+}
+
+typedef struct {
+    int id;
+    int ops;
+} RateLimitBench;
+
+static void *rate_limit_bench_worker(void *arg) {
+    RateLimitBench *b = arg;
+    char ip[64];
+    unsigned int seed = (unsigned int)b->id;
+
+    for (int i = 0; i < b->ops; i++) {
+        unsigned int r = (unsigned int)rand_r(&seed);
+        snprintf(ip, sizeof(ip), "10.%u.%u.%u", (r >> 16) & 0xff, (r >> 8) & 0xff, r & 0xff);
+        if (get_failed_attempts(ip) < MAX_ATTEMPTS) {
+            increment_failed_attempts(ip);
+        }
+    }
+    return NULL;
+}
+
+// Mide operaciones/s de la tabla con varios hilos compitiendo sobre IPs aleatorias
+int run_rate_limit_bench(int threads, int ops) {
+    pthread_t tids[256];
+    RateLimitBench args[256];
+    struct timespec t0, t1;
+
+    if (threads < 1 || threads > 256 || ops < 1) {
+        fprintf(stderr, "Parámetros de benchmark inválidos\n");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < threads; i++) {
+        args[i].id = i + 1;
+        args[i].ops = ops;
+        pthread_create(&tids[i], NULL, rate_limit_bench_worker, &args[i]);
     }
-    strncpy(failed_logins[failed_logins_count].ip, ip, 63);
-    failed_logins[failed_logins_count].attempts = 1;
-    failed_logins_count++;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%d hilos, %d ops/hilo: %.0f ops/s (%.1f ns/op), memoria de la tabla: %zu KB\n",
+           threads, ops, threads * (double)ops / secs,
+           secs * 1e9 / ((double)threads * ops), sizeof(failed_logins) / 1024);
+    return 0;
 }
 
 int login_handler(struct mg_connection *conn, void *cbdata) {
@@ -99,37 +319,35 @@ int login_handler(struct mg_connection *conn, void *cbdata) {
                   "</form>"
                   "</body></html>");
     } else if (strcmp(req_info->request_method, "POST") == 0) {
-        char post_data[1024];
-        int post_data_len = mg_read(conn, post_data, sizeof(post_data) - 1);
-        if (post_data_len <= 0 || post_data_len >= sizeof(post_data)) {
+        // Lectura por fragmentos: el parser decodifica los campos en buffers fijos
+        char chunk[READ_CHUNK];
+        struct form_parser form;
+        long long total = 0;
+        int n;
+
+        form_parser_init(&form, form_tipo_de(mg_get_header(conn, "Content-Type")));
+        while ((n = mg_read(conn, chunk, sizeof(chunk))) > 0) {
+            total += n;
+            if (total > MAX_BODY_LEN || form_parser_feed(&form, chunk, (size_t)n) < 0) {
+                break;
+            }
+        }
+        if (n < 0 || total == 0 || total > MAX_BODY_LEN) {
             mg_printf(conn,
                       "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\n\r\n"
                       "Error leyendo el cuerpo de la solicitud");
             return 1;
         }
 
-        post_data[post_data_len] = '\0';
-
-        char *username_param = strstr(post_data, "username=");
-        char *password_param = strstr(post_data, "password=");
-
-        if (!username_param || !password_param) {
+        if (form_parser_finish(&form) < 0) {
             mg_printf(conn,
                       "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\n\r\n"
-                      "Parámetros incompletos\n");
+                      "Parámetros incompletos o formato inválido\n");
             return 1;
         }
 
-        char *username = username_param + 9;
-        char *amp = strchr(username, '&');
-        if (!amp) {
-            mg_printf(conn,
-                      "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\n\r\n"
-                      "Formato inválido\n");
-            return 1;
-        }
-        *amp = '\0';
-        char *password = amp + 10;
+        const char *username = form.username;
+        const char *password = form.password;
 
         if (strlen(username) > 50 || strlen(password) > 50) {
             mg_printf(conn,
@@ -138,7 +356,7 @@ int login_handler(struct mg_connection *conn, void *cbdata) {
             return 1;
         }
 
-        if (get_failed_attempts(client_ip) >= MAX_ATTEMPTS) {
+        if (max_attempts > 0 && get_failed_attempts(client_ip) >= max_attempts) {
             mg_printf(conn,
                       "HTTP/1.1 429 Too Many Requests\r\nContent-Type: text/plain\r\n\r\n"
                       "Demasiados intentos fallidos");
@@ -146,11 +364,18 @@ int login_handler(struct mg_connection *conn, void *cbdata) {
         }
 
         if (check_credentials(username, password)) {
+            char token[SESSION_TOKEN_HEX + 1];
+            if (!session_create(username, token)) {
+                mg_printf(conn,
+                          "HTTP/1.1 503 Service Unavailable\r\nContent-Type: text/plain\r\n\r\n"
+                          "Servidor saturado\n");
+                return 1;
+            }
             mg_printf(conn,
                       "HTTP/1.1 200 OK\r\n"
-                      "Set-Cookie: session=valida; HttpOnly\r\n"
+                      "Set-Cookie: session=%s; Max-Age=%d; Path=/; HttpOnly; SameSite=Strict\r\n"
                       "Content-Type: text/plain\r\n\r\n"
-                      "Login exitoso\n");
+                      "Login exitoso\n", token, SESSION_TTL);
         } else {
             increment_failed_attempts(client_ip);
             mg_printf(conn,
@@ -162,7 +387,82 @@ int login_handler(struct mg_connection *conn, void *cbdata) {
     return 1;
 }
 
-int main() {
+// Valida la cookie de sesión en memoria, sin volver a tocar SQLite
+int session_handler(struct mg_connection *conn, void *cbdata) {
+    const char *cookies = mg_get_header(conn, "Cookie");
+    char token[SESSION_TOKEN_HEX + 1];
+    char username[SESSION_USER_MAX + 1];
+
+    if (cookies && mg_get_cookie(cookies, "session", token, sizeof(token)) == SESSION_TOKEN_HEX &&
+        session_validate(token, username, sizeof(username))) {
+        mg_printf(conn,
+                  "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\n"
+                  "Sesión válida\n");
+    } else {
+        mg_printf(conn,
+                  "HTTP/1.1 401 Unauthorized\r\nContent-Type: text/plain\r\n\r\n"
+                  "Sesión inválida o caducada\n");
+    }
+    return 1;
+}
+
+static double parse_bench_pass(enum form_tipo tipo, const char *body, size_t chunk, int iters) {
+    size_t len = strlen(body);
+    struct form_parser form;
+    struct timespec t0, t1;
+    int ok = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < iters; i++) {
+        form_parser_init(&form, tipo);
+        for (size_t off = 0; off < len; off += chunk) {
+            form_parser_feed(&form, body + off, len - off < chunk ? len - off : chunk);
+        }
+        ok += (form_parser_finish(&form) == 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("  %-10s fragmentos de %4zu B: %.0f cuerpos/s, %.1f MB/s (%d/%d válidos)\n",
+           tipo == FORM_JSON ? "json" : "urlencoded", chunk, iters / secs,
+           (double)len * iters / secs / (1024 * 1024), ok, iters);
+    return secs;
+}
+
+// Mide el rendimiento del parser de cuerpos con distintos tamaños de fragmento
+int run_parser_bench(int iters) {
+    static const char urlencoded[] = "username=usuario%40example.com&password=s3cr3t%21+con+espacios";
+    static const char json[] = "{\"username\": \"usuario@example.com\", \"password\": \"s3cr3t!\\u00e9\"}";
+    static const size_t chunks[] = {7, 64, READ_CHUNK};
+
+    if (iters < 1) {
+        fprintf(stderr, "Parámetros de benchmark inválidos\n");
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        parse_bench_pass(FORM_URLENCODED, urlencoded, chunks[i], iters);
+        parse_bench_pass(FORM_JSON, json, chunks[i], iters);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 4 && strcmp(argv[1], "--bench-ratelimit") == 0) {
+        return run_rate_limit_bench(atoi(argv[2]), atoi(argv[3]));
+    }
+    if (argc == 3 && strcmp(argv[1], "--bench-parser") == 0) {
+        return run_parser_bench(atoi(argv[2]));
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--max-attempts") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 0) {
+            max_attempts = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Uso: %s [--max-attempts N (0 = sin límite)]\n"
+                            "     %s --bench-ratelimit HILOS OPS | --bench-parser N\n", argv[0], argv[0]);
+            return 1;
+        }
+    }
+
     const char *options[] = {
         "document_root", ".",
         "listening_ports", "8080",
@@ -172,11 +472,14 @@ int main() {
     struct mg_callbacks callbacks;
     memset(&callbacks, 0, sizeof(callbacks));
 
-    struct mg_context *ctx = mg_start(&callbacks, 0, options);
-
     init_database();
+    init_thread_db_key();
+    session_store_init();
+
+    struct mg_context *ctx = mg_start(&callbacks, 0, options);
 
     mg_set_request_handler(ctx, "/login", login_handler, 0);
+    mg_set_request_handler(ctx, "/sesion", session_handler, 0);
 
     printf("Servidor corriendo en http://localhost:8080/login\n");
     getchar();
@@ -0,0 +1,285 @@
+#ifndef FORM_PARSER_H
+#define FORM_PARSER_H
+
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+
+// Parser incremental de cuerpos de login (urlencoded o JSON) compartido por los
+// servidores de caso5. Decodifica username/password directamente en buffers fijos
+// de la estructura, sin memoria dinámica, aunque los campos lleguen partidos en
+// varios fragmentos de la subida.
+
+#define FORM_FIELD_MAX 100
+#define FORM_KEY_MAX 16
+
+enum form_tipo { FORM_URLENCODED, FORM_JSON };
+
+enum form_estado {
+    FORM_CLAVE,          // urlencoded: leyendo nombre del campo
+    FORM_VALOR,          // urlencoded: leyendo valor
+    FORM_JSON_INICIO,    // esperando '{'
+    FORM_JSON_ANTES_CLAVE,
+    FORM_JSON_CLAVE,
+    FORM_JSON_DOS_PUNTOS,
+    FORM_JSON_ANTES_VALOR,
+    FORM_JSON_VALOR,
+    FORM_JSON_DESPUES_VALOR,
+    FORM_JSON_FIN,
+    FORM_ERROR
+};
+
+struct form_parser {
+    enum form_tipo tipo;
+    enum form_estado estado;
+    char clave[FORM_KEY_MAX];
+    size_t clave_len;
+    char *destino;        // Buffer del campo actual o NULL si se ignora
+    size_t *destino_len;
+    int escape;           // JSON: 1 tras '\\', 2..5 dígitos de \uXXXX; urlencoded: 1..2 dígitos de %XX
+    unsigned int codigo;
+    char username[FORM_FIELD_MAX + 1];
+    char password[FORM_FIELD_MAX + 1];
+    size_t username_len;
+    size_t password_len;
+    int tiene_username;
+    int tiene_password;
+};
+
+static inline void form_parser_init(struct form_parser *p, enum form_tipo tipo) {
+    memset(p, 0, sizeof(*p));
+    p->tipo = tipo;
+    p->estado = (tipo == FORM_JSON) ? FORM_JSON_INICIO : FORM_CLAVE;
+}
+
+// Elige el tipo de parser a partir de la cabecera Content-Type
+static inline enum form_tipo form_tipo_de(const char *content_type) {
+    if (content_type && strncasecmp(content_type, "application/json", 16) == 0) {
+        return FORM_JSON;
+    }
+    return FORM_URLENCODED;
+}
+
+static inline int form_hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Añade un byte ya decodificado a la clave o al valor en curso. Un NUL (crudo,
+// %00 o \u0000) invalida el cuerpo: los campos se usan como cadenas C y
+// "pass%00basura" se verificaría como "pass"
+static inline void form_emitir(struct form_parser *p, char c, int en_clave) {
+    if (c == '\0') {
+        p->estado = FORM_ERROR;
+        return;
+    }
+    if (en_clave) {
+        if (p->clave_len < FORM_KEY_MAX - 1) {
+            p->clave[p->clave_len++] = c;
+        } else {
+            p->clave_len = FORM_KEY_MAX; // Clave desconocida: el valor se ignorará
+        }
+        return;
+    }
+    if (!p->destino) {
+        return;
+    }
+    if (*p->destino_len >= FORM_FIELD_MAX) {
+        p->estado = FORM_ERROR;
+        return;
+    }
+    p->destino[(*p->destino_len)++] = c;
+    p->destino[*p->destino_len] = '\0';
+}
+
+// Cierra la clave y apunta el destino al campo correspondiente
+static inline void form_seleccionar_campo(struct form_parser *p) {
+    p->destino = NULL;
+    if (p->clave_len == 8 && memcmp(p->clave, "username", 8) == 0) {
+        p->destino = p->username;
+        p->destino_len = &p->username_len;
+        p->tiene_username = 1;
+    } else if (p->clave_len == 8 && memcmp(p->clave, "password", 8) == 0) {
+        p->destino = p->password;
+        p->destino_len = &p->password_len;
+        p->tiene_password = 1;
+    }
+    if (p->destino) {
+        *p->destino_len = 0;
+        p->destino[0] = '\0';
+    }
+    p->clave_len = 0;
+}
+
+// Codifica un punto de código \uXXXX como UTF-8 (sólo plano básico)
+static inline void form_emitir_utf8(struct form_parser *p, unsigned int cp, int en_clave) {
+    if (cp < 0x80) {
+        form_emitir(p, (char)cp, en_clave);
+    } else if (cp < 0x800) {
+        form_emitir(p, (char)(0xC0 | (cp >> 6)), en_clave);
+        form_emitir(p, (char)(0x80 | (cp & 0x3F)), en_clave);
+    } else {
+        form_emitir(p, (char)(0xE0 | (cp >> 12)), en_clave);
+        form_emitir(p, (char)(0x80 | ((cp >> 6) & 0x3F)), en_clave);
+        form_emitir(p, (char)(0x80 | (cp & 0x3F)), en_clave);
+    }
+}
+
+static inline void form_byte_urlencoded(struct form_parser *p, char c) {
+    int en_clave = (p->estado == FORM_CLAVE);
+
+    if (p->escape) {
+        int v = form_hex(c);
+        if (v < 0) {
+            p->estado = FORM_ERROR;
+            return;
+        }
+        p->codigo = (p->codigo << 4) | (unsigned int)v;
+        if (++p->escape == 3) {
+            p->escape = 0;
+            form_emitir(p, (char)p->codigo, en_clave);
+        }
+        return;
+    }
+
+    switch (c) {
+        case '&':
+            if (en_clave) {
+                p->clave_len = 0; // Campo sin '=': se ignora
+            }
+            p->destino = NULL;
+            p->estado = FORM_CLAVE;
+            break;
+        case '=':
+            if (en_clave) {
+                form_seleccionar_campo(p);
+                p->estado = FORM_VALOR;
+            } else {
+                form_emitir(p, c, 0);
+            }
+            break;
+        case '%':
+            p->escape = 1;
+            p->codigo = 0;
+            break;
+        case '+':
+            form_emitir(p, ' ', en_clave);
+            break;
+        default:
+            form_emitir(p, c, en_clave);
+    }
+}
+
+static inline int form_es_espacio(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline void form_byte_json(struct form_parser *p, char c) {
+    int en_clave = (p->estado == FORM_JSON_CLAVE);
+
+    switch (p->estado) {
+        case FORM_JSON_INICIO:
+            if (c == '{') p->estado = FORM_JSON_ANTES_CLAVE;
+            else if (!form_es_espacio(c)) p->estado = FORM_ERROR;
+            return;
+        case FORM_JSON_ANTES_CLAVE:
+            if (c == '"') p->estado = FORM_JSON_CLAVE;
+            else if (c == '}') p->estado = FORM_JSON_FIN;
+            else if (!form_es_espacio(c)) p->estado = FORM_ERROR;
+            return;
+        case FORM_JSON_DOS_PUNTOS:
+            if (c == ':') p->estado = FORM_JSON_ANTES_VALOR;
+            else if (!form_es_espacio(c)) p->estado = FORM_ERROR;
+            return;
+        case FORM_JSON_ANTES_VALOR:
+            // Sólo se aceptan valores de tipo cadena
+            if (c == '"') p->estado = FORM_JSON_VALOR;
+            else if (!form_es_espacio(c)) p->estado = FORM_ERROR;
+            return;
+        case FORM_JSON_DESPUES_VALOR:
+            if (c == ',') p->estado = FORM_JSON_ANTES_CLAVE;
+            else if (c == '}') p->estado = FORM_JSON_FIN;
+            else if (!form_es_espacio(c)) p->estado = FORM_ERROR;
+            return;
+        case FORM_JSON_FIN:
+            if (!form_es_espacio(c)) p->estado = FORM_ERROR;
+            return;
+        case FORM_JSON_CLAVE:
+        case FORM_JSON_VALOR:
+            break;
+        default:
+            return;
+    }
+
+    // Dentro de una cadena: clave o valor
+    if (p->escape == 1) {
+        p->escape = 0;
+        switch (c) {
+            case '"': case '\\': case '/': form_emitir(p, c, en_clave); break;
+            case 'b': form_emitir(p, '\b', en_clave); break;
+            case 'f': form_emitir(p, '\f', en_clave); break;
+            case 'n': form_emitir(p, '\n', en_clave); break;
+            case 'r': form_emitir(p, '\r', en_clave); break;
+            case 't': form_emitir(p, '\t', en_clave); break;
+            case 'u': p->escape = 2; p->codigo = 0; break;
+            default: p->estado = FORM_ERROR;
+        }
+        return;
+    }
+    if (p->escape >= 2) {
+        int v = form_hex(c);
+        if (v < 0) {
+            p->estado = FORM_ERROR;
+            return;
+        }
+        p->codigo = (p->codigo << 4) | (unsigned int)v;
+        if (++p->escape == 6) {
+            p->escape = 0;
+            form_emitir_utf8(p, p->codigo, en_clave);
+        }
+        return;
+    }
+
+    if (c == '\\') {
+        p->escape = 1;
+    } else if (c == '"') {
+        if (en_clave) {
+            form_seleccionar_campo(p);
+            p->estado = FORM_JSON_DOS_PUNTOS;
+        } else {
+            p->destino = NULL;
+            p->estado = FORM_JSON_DESPUES_VALOR;
+        }
+    } else if ((unsigned char)c < 0x20) {
+        p->estado = FORM_ERROR;
+    } else {
+        form_emitir(p, c, en_clave);
+    }
+}
+
+// Procesa un fragmento del cuerpo; devuelve 0 si va bien, -1 si el cuerpo es inválido
+static inline int form_parser_feed(struct form_parser *p, const char *data, size_t len) {
+    for (size_t i = 0; i < len && p->estado != FORM_ERROR; i++) {
+        if (p->tipo == FORM_JSON) {
+            form_byte_json(p, data[i]);
+        } else {
+            form_byte_urlencoded(p, data[i]);
+        }
+    }
+    return p->estado == FORM_ERROR ? -1 : 0;
+}
+
+// Comprueba que el cuerpo terminó bien y trae ambos campos
+static inline int form_parser_finish(struct form_parser *p) {
+    if (p->estado == FORM_ERROR || p->escape) {
+        return -1;
+    }
+    if (p->tipo == FORM_JSON && p->estado != FORM_JSON_FIN) {
+        return -1;
+    }
+    return (p->tiene_username && p->tiene_password) ? 0 : -1;
+}
+
+#endif
@@ -3,20 +3,183 @@
 #include <string.h>
 #include <stdlib.h>
 #include <libpq-fe.h>
+#include <pthread.h>
+#include <time.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
 #include <openssl/sha.h>
 #include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <zlib.h>
+#include "form_parser.h"
+#include "session_store.h"
 
 #define PORT 8080
 #define MAX_INPUT_LEN 100
 #define SALT_LEN 32
+#define POOL_SIZE 8
+#define DB_CONNINFO "dbname=usuarios user=postgres password=tu_password host=localhost"
+#define STMT_USUARIO "buscar_usuario"
+#define SQL_USUARIO "SELECT salt, password_hash FROM usuarios WHERE username = $1"
+#define HASH_WORKERS 4
+#define HASH_QUEUE_LEN 256
+#define LATENCY_SAMPLES 8192
+#define HASH_LEN 32
+#define CRED_CACHE_SLOTS 1024     // Usuarios verificados (username -> salt, hash)
+#define NEG_CACHE_SLOTS 8192      // Usuarios inexistentes
+#define CRED_CACHE_TTL 300
+#define NEG_CACHE_TTL 60
+#define CACHE_LOCKS 32
+#define MAX_PEM_LEN (1024 * 1024) // Límite de cordura: una cadena de certificados cabe de sobra
+#define GZIP_MIN_LEN 128          // Por debajo, la cabecera gzip no compensa
 
-// Estructura para conexión segura
-struct connection_info {
+// Respuestas fijas creadas una vez al arrancar y compartidas entre peticiones
+enum respuesta {
+    RESP_FORM,
+    RESP_LOGIN_OK,
+    RESP_LOGIN_FALLO,
+    RESP_INVALIDA,
+    RESP_NO_ENCONTRADA,
+    RESP_NO_PERMITIDO,
+    RESP_SATURADO,
+    RESP_SESION_OK,
+    RESP_NO_AUTORIZADO,
+    RESP_SESION_CERRADA,
+    NUM_RESPUESTAS
+};
+
+struct respuesta_estatica {
+    unsigned int status;
+    const char *content_type;
+    const char *cuerpo;
+    struct MHD_Response *plano;
+    struct MHD_Response *gzip;   // NULL si no se generó variante comprimida
+    unsigned char *gzip_buf;
+};
+
+static struct respuesta_estatica respuestas[NUM_RESPUESTAS] = {
+    [RESP_FORM] = {MHD_HTTP_OK, "text/html; charset=utf-8",
+                   "<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>Login</title></head>"
+                   "<body><h2>Login</h2><form method=\"post\" action=\"/login\">"
+                   "<label>Usuario: <input type=\"text\" name=\"username\" maxlength=\"100\"></label><br>"
+                   "<label>Contraseña: <input type=\"password\" name=\"password\" maxlength=\"100\"></label><br>"
+                   "<input type=\"submit\" value=\"Entrar\"></form></body></html>"},
+    [RESP_LOGIN_OK] = {MHD_HTTP_OK, "text/plain; charset=utf-8", "Login exitoso"},
+    [RESP_LOGIN_FALLO] = {MHD_HTTP_OK, "text/plain; charset=utf-8", "Credenciales inválidas"},
+    [RESP_INVALIDA] = {MHD_HTTP_BAD_REQUEST, "text/plain; charset=utf-8", "Solicitud inválida"},
+    [RESP_NO_ENCONTRADA] = {MHD_HTTP_NOT_FOUND, "text/plain; charset=utf-8", "Ruta no encontrada"},
+    [RESP_NO_PERMITIDO] = {MHD_HTTP_METHOD_NOT_ALLOWED, "text/plain; charset=utf-8", "Método no permitido"},
+    [RESP_SATURADO] = {MHD_HTTP_SERVICE_UNAVAILABLE, "text/plain; charset=utf-8", "Servidor saturado"},
+    [RESP_SESION_OK] = {MHD_HTTP_OK, "text/plain; charset=utf-8", "Sesión válida"},
+    [RESP_NO_AUTORIZADO] = {MHD_HTTP_UNAUTHORIZED, "text/plain; charset=utf-8", "Sesión inválida o caducada"},
+    [RESP_SESION_CERRADA] = {MHD_HTTP_OK, "text/plain; charset=utf-8", "Sesión cerrada"},
+};
+
+// Parámetros del demonio configurables por línea de comandos
+struct server_config {
+    unsigned int hilos;           // 1 = un solo hilo de polling, >1 = pool con epoll
+    unsigned int max_conexiones;
+    unsigned int por_ip;          // 0 = sin límite por IP
+    unsigned int timeout;         // Segundos de inactividad antes de cerrar
+    size_t limite_memoria;        // Bytes por conexión
+};
+
+// Pool fijo de conexiones a PostgreSQL compartido por los hilos del servidor
+struct db_pool {
+    PGconn *conns[POOL_SIZE];
+    int libres[POOL_SIZE];
+    int num_libres;
+    pthread_mutex_t lock;
+    pthread_cond_t disponible;
+};
+
+static struct db_pool pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .disponible = PTHREAD_COND_INITIALIZER
+};
+
+// Verificación pendiente; la resuelve un hilo del pool de hashing
+struct hash_job {
+    const char *username;
+    const char *password;
+    int result;                 // 1 válido, 0 inválido, -1 cola llena
+    int done;
+    struct timespec encolado;
+    void (*on_done)(struct hash_job *job);
+    void *ctx;
+};
+
+// Pool de hilos dedicado al KDF con cola acotada
+struct hash_pool {
+    struct hash_job *cola[HASH_QUEUE_LEN];
+    int cabeza;
+    int pendientes;
+    int en_curso;               // Trabajos sacados de la cola cuyo on_done no ha vuelto
+    int parar;
+    pthread_t workers[HASH_WORKERS];
+    pthread_mutex_t lock;
+    pthread_cond_t hay_trabajo;
+    pthread_cond_t terminado;
+};
+
+static struct hash_pool hasher = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .hay_trabajo = PTHREAD_COND_INITIALIZER,
+    .terminado = PTHREAD_COND_INITIALIZER
+};
+
+// Latencias (encolado -> verificado) de las últimas LATENCY_SAMPLES verificaciones
+struct latencias {
+    double muestras[LATENCY_SAMPLES];
+    unsigned long total;
+    pthread_mutex_t lock;
+};
+
+static struct latencias lat = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Entrada de la caché de credenciales; negativa = usuario inexistente
+struct cred_entry {
     char username[MAX_INPUT_LEN + 1];
-    char password[MAX_INPUT_LEN + 1]; 
+    unsigned char salt[SALT_LEN];
+    unsigned char hash[HASH_LEN];
+    time_t expira;
+    unsigned int generacion;
+};
+
+struct cred_cache {
+    struct cred_entry positivos[CRED_CACHE_SLOTS];
+    struct cred_entry negativos[NEG_CACHE_SLOTS];
+    pthread_mutex_t locks[CACHE_LOCKS];
+    atomic_uint generacion;       // Incrementarla invalida toda la caché (SIGUSR1)
+    atomic_ulong aciertos;
+    atomic_ulong aciertos_negativos;
+    atomic_ulong fallos;
+};
+
+static struct cred_cache cache;
+
+// Estructura para conexión segura; los campos se decodifican en el propio parser
+struct connection_info {
+    struct form_parser form;
+    int cuerpo_invalido;
     int login_success;
+    int en_cola;
+    struct hash_job job;
+    struct connection_info *siguiente; // Lista de libres
+};
+
+// Arena fija de estados de conexión reservada al arrancar: sin malloc por petición
+struct con_info_pool {
+    struct connection_info *slots;
+    struct connection_info *libres;
+    pthread_mutex_t lock;
 };
 
+static struct con_info_pool con_infos = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
 // Genera hash seguro de contraseña con salt
 void generate_hash(const char *password, const unsigned char *salt, char *output) {
     PKCS5_PBKDF2_HMAC(password, strlen(password),
@@ -27,152 +190,1053 @@ void generate_hash(const char *password, const unsigned char *salt, char *output
                      (unsigned char *)output);
 }
 
-// Verifica credenciales de forma segura
-int check_credentials(const char *username, const char *password) {
-    PGconn *conn = PQconnectdb("dbname=usuarios user=postgres password=tu_password host=localhost");
+// Prepara las sentencias de una conexión recién abierta o restablecida
+static int preparar_conexion(PGconn *conn) {
     if (PQstatus(conn) != CONNECTION_OK) {
-        fprintf(stderr, "Error de conexión\n");
-        PQfinish(conn);
         return 0;
     }
+    PGresult *res = PQprepare(conn, STMT_USUARIO, SQL_USUARIO, 1, NULL);
+    int ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+    if (!ok) {
+        fprintf(stderr, "Error al preparar consulta: %s", PQerrorMessage(conn));
+    }
+    PQclear(res);
+    return ok;
+}
 
-    // Consulta preparada para evitar SQLi
+// Abre todas las conexiones del pool una única vez al arrancar
+int pool_init(void) {
+    for (int i = 0; i < POOL_SIZE; i++) {
+        pool.conns[i] = PQconnectdb(DB_CONNINFO);
+        if (!preparar_conexion(pool.conns[i])) {
+            fprintf(stderr, "Error de conexión: %s", PQerrorMessage(pool.conns[i]));
+            for (int j = 0; j <= i; j++) {
+                PQfinish(pool.conns[j]);
+            }
+            return 0;
+        }
+        pool.libres[i] = i;
+    }
+    pool.num_libres = POOL_SIZE;
+    return 1;
+}
+
+void pool_destroy(void) {
+    pthread_mutex_lock(&pool.lock);
+    for (int i = 0; i < POOL_SIZE; i++) {
+        PQfinish(pool.conns[i]);
+        pool.conns[i] = NULL;
+    }
+    pool.num_libres = 0;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+// Obtiene una conexión sana del pool, bloqueando si todas están en uso
+static int pool_acquire(void) {
+    pthread_mutex_lock(&pool.lock);
+    while (pool.num_libres == 0) {
+        pthread_cond_wait(&pool.disponible, &pool.lock);
+    }
+    int idx = pool.libres[--pool.num_libres];
+    pthread_mutex_unlock(&pool.lock);
+
+    // Comprobación de salud: reconectar y volver a preparar si se perdió la conexión
+    PGconn *conn = pool.conns[idx];
+    if (PQstatus(conn) != CONNECTION_OK) {
+        PQreset(conn);
+        if (!preparar_conexion(conn)) {
+            fprintf(stderr, "Conexión %d no disponible: %s", idx, PQerrorMessage(conn));
+        }
+    }
+    return idx;
+}
+
+static void pool_release(int idx) {
+    pthread_mutex_lock(&pool.lock);
+    pool.libres[pool.num_libres++] = idx;
+    pthread_cond_signal(&pool.disponible);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+// Ejecuta la consulta preparada; devuelve NULL si el usuario no existe
+// (indicado en *no_existe) o si la consulta falla
+static PGresult *buscar_usuario(PGconn *conn, const char *username, int *no_existe) {
     const char *paramValues[1] = {username};
-    PGresult *res = PQexecParams(conn,
-                               "SELECT salt, password_hash FROM usuarios WHERE username = $1",
-                               1, NULL, paramValues, NULL, NULL, 0);
+    PGresult *res = PQexecPrepared(conn, STMT_USUARIO, 1, paramValues, NULL, NULL, 0);
 
     if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
+        if (no_existe) {
+            *no_existe = (PQresultStatus(res) == PGRES_TUPLES_OK);
+        }
         PQclear(res);
-        PQfinish(conn);
+        return NULL;
+    }
+    return res;
+}
+
+static unsigned long hash_username(const char *username) {
+    unsigned long h = 1469598103934665603UL; // FNV-1a
+    for (; *username; username++) {
+        h ^= (unsigned char)*username;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+static void invalidar_cache_senal(int sig) {
+    (void)sig;
+    atomic_fetch_add(&cache.generacion, 1);
+}
+
+void cred_cache_init(void) {
+    for (int i = 0; i < CACHE_LOCKS; i++) {
+        pthread_mutex_init(&cache.locks[i], NULL);
+    }
+    signal(SIGUSR1, invalidar_cache_senal);
+}
+
+static int entrada_vigente(const struct cred_entry *e, const char *username, time_t ahora) {
+    return e->expira > ahora &&
+           e->generacion == atomic_load(&cache.generacion) &&
+           strcmp(e->username, username) == 0;
+}
+
+// Devuelve 1 si hay credenciales en caché, -1 si el usuario se sabe inexistente, 0 si no hay dato
+static int cred_cache_lookup(const char *username, unsigned char *salt, unsigned char *hash) {
+    unsigned long h = hash_username(username);
+    pthread_mutex_t *lock = &cache.locks[h % CACHE_LOCKS];
+    time_t ahora = time(NULL);
+    int estado = 0;
+
+    pthread_mutex_lock(lock);
+    struct cred_entry *pos = &cache.positivos[h % CRED_CACHE_SLOTS];
+    struct cred_entry *neg = &cache.negativos[h % NEG_CACHE_SLOTS];
+    if (entrada_vigente(pos, username, ahora)) {
+        memcpy(salt, pos->salt, SALT_LEN);
+        memcpy(hash, pos->hash, HASH_LEN);
+        estado = 1;
+    } else if (entrada_vigente(neg, username, ahora)) {
+        estado = -1;
+    }
+    pthread_mutex_unlock(lock);
+
+    if (estado > 0) {
+        atomic_fetch_add(&cache.aciertos, 1);
+    } else if (estado < 0) {
+        atomic_fetch_add(&cache.aciertos_negativos, 1);
+    } else {
+        atomic_fetch_add(&cache.fallos, 1);
+    }
+    return estado;
+}
+
+static void cred_cache_store(const char *username, const unsigned char *salt,
+                             const unsigned char *hash) {
+    unsigned long h = hash_username(username);
+    pthread_mutex_t *lock = &cache.locks[h % CACHE_LOCKS];
+    struct cred_entry *e = salt ? &cache.positivos[h % CRED_CACHE_SLOTS]
+                                : &cache.negativos[h % NEG_CACHE_SLOTS];
+
+    pthread_mutex_lock(lock);
+    snprintf(e->username, sizeof(e->username), "%s", username);
+    if (salt) {
+        memcpy(e->salt, salt, SALT_LEN);
+        memcpy(e->hash, hash, HASH_LEN);
+    }
+    e->expira = time(NULL) + (salt ? CRED_CACHE_TTL : NEG_CACHE_TTL);
+    e->generacion = atomic_load(&cache.generacion);
+    pthread_mutex_unlock(lock);
+}
+
+// Invalidación explícita, p. ej. tras cambiar la contraseña o crear el usuario
+void cred_cache_invalidate(const char *username) {
+    unsigned long h = hash_username(username);
+    pthread_mutex_t *lock = &cache.locks[h % CACHE_LOCKS];
+
+    pthread_mutex_lock(lock);
+    struct cred_entry *pos = &cache.positivos[h % CRED_CACHE_SLOTS];
+    struct cred_entry *neg = &cache.negativos[h % NEG_CACHE_SLOTS];
+    if (strcmp(pos->username, username) == 0) {
+        pos->expira = 0;
+    }
+    if (strcmp(neg->username, username) == 0) {
+        neg->expira = 0;
+    }
+    pthread_mutex_unlock(lock);
+}
+
+void cred_cache_report(void) {
+    unsigned long pos = atomic_load(&cache.aciertos);
+    unsigned long neg = atomic_load(&cache.aciertos_negativos);
+    unsigned long miss = atomic_load(&cache.fallos);
+    unsigned long total = pos + neg + miss;
+
+    printf("  caché de credenciales: %lu aciertos, %lu aciertos negativos, %lu fallos "
+           "(tasa de acierto %.1f%%)\n",
+           pos, neg, miss, total ? 100.0 * (pos + neg) / total : 0.0);
+}
+
+// Copia un campo de la fila limitado a len bytes, rellenando con ceros
+static void copiar_campo(PGresult *res, int col, unsigned char *dst, size_t len) {
+    size_t n = (size_t)PQgetlength(res, 0, col);
+    memset(dst, 0, len);
+    memcpy(dst, PQgetvalue(res, 0, col), n < len ? n : len);
+}
+
+// Lee salt y hash del usuario con una conexión del pool; 0 si no se obtuvieron
+static int consultar_credenciales(const char *username, unsigned char *salt,
+                                  unsigned char *stored_hash, int *no_existe) {
+    int idx = pool_acquire();
+    PGconn *conn = pool.conns[idx];
+    if (PQstatus(conn) != CONNECTION_OK) {
+        pool_release(idx);
         return 0;
     }
 
-    // Verificación segura del hash
-    unsigned char *salt = (unsigned char *)PQgetvalue(res, 0, 0);
-    char *stored_hash = PQgetvalue(res, 0, 1);
-    char computed_hash[32];
+    // Consulta preparada para evitar SQLi
+    PGresult *res = buscar_usuario(conn, username, no_existe);
+    pool_release(idx);
+    if (!res) {
+        return 0;
+    }
+
+    copiar_campo(res, 0, salt, SALT_LEN);
+    copiar_campo(res, 1, stored_hash, HASH_LEN);
+    PQclear(res);
+    return 1;
+}
+
+// Verificación segura del hash
+static int verificar_hash(const char *password, const unsigned char *salt,
+                          const unsigned char *stored_hash) {
+    char computed_hash[HASH_LEN];
     
     generate_hash(password, salt, computed_hash);
     
-    int result = (memcmp(stored_hash, computed_hash, 32) == 0);
-    
-    PQclear(res);
+    return memcmp(stored_hash, computed_hash, HASH_LEN) == 0;
+}
+
+// Verifica credenciales de forma segura
+int check_credentials(const char *username, const char *password) {
+    unsigned char salt[SALT_LEN];
+    unsigned char stored_hash[HASH_LEN];
+
+    int estado = cred_cache_lookup(username, salt, stored_hash);
+    if (estado < 0) {
+        return 0; // Usuario inexistente conocido: sin ida y vuelta a la base de datos
+    }
+
+    if (estado == 0) {
+        int no_existe = 0;
+        if (!consultar_credenciales(username, salt, stored_hash, &no_existe)) {
+            if (no_existe) {
+                cred_cache_store(username, NULL, NULL);
+            }
+            return 0;
+        }
+        cred_cache_store(username, salt, stored_hash);
+    }
+
+    return verificar_hash(password, salt, stored_hash);
+}
+
+// Misma verificación con el pool pero consultando siempre la base de datos,
+// para que el benchmark mida el pool y no los aciertos de la caché
+static int check_credentials_sin_cache(const char *username, const char *password) {
+    unsigned char salt[SALT_LEN];
+    unsigned char stored_hash[HASH_LEN];
+
+    if (!consultar_credenciales(username, salt, stored_hash, NULL)) {
+        return 0;
+    }
+    return verificar_hash(password, salt, stored_hash);
+}
+
+// Ruta anterior (una conexión por login), conservada sólo para el benchmark
+static int check_credentials_sin_pool(const char *username, const char *password) {
+    PGconn *conn = PQconnectdb(DB_CONNINFO);
+    if (!preparar_conexion(conn)) {
+        PQfinish(conn);
+        return 0;
+    }
+    PGresult *res = buscar_usuario(conn, username, NULL);
     PQfinish(conn);
+    if (!res) {
+        return 0;
+    }
+    char computed_hash[32];
+    generate_hash(password, (unsigned char *)PQgetvalue(res, 0, 0), computed_hash);
+    int result = (memcmp(PQgetvalue(res, 0, 1), computed_hash, 32) == 0);
+    PQclear(res);
     return result;
 }
 
-// Callback seguro para POST
-static int post_iterator(void *cls, enum MHD_ValueKind kind, 
-                         const char *key, const char *filename,
-                         const char *content_type, const char *transfer_encoding,
-                         const char *data, uint64_t off, size_t size) {
-    struct connection_info *con_info = cls;
-    
-    if (size > MAX_INPUT_LEN) return MHD_NO;
+static double ms_desde(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+static void registrar_latencia(double ms) {
+    pthread_mutex_lock(&lat.lock);
+    lat.muestras[lat.total % LATENCY_SAMPLES] = ms;
+    lat.total++;
+    pthread_mutex_unlock(&lat.lock);
+}
+
+static int comparar_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
 
-    if (strcmp(key, "username") == 0) {
-        strncpy(con_info->username, data, size);
-        con_info->username[size] = '\0';
-    } 
-    else if (strcmp(key, "password") == 0) {
-        strncpy(con_info->password, data, size);
-        con_info->password[size] = '\0';
+static void reportar_latencias(const char *etiqueta) {
+    static double copia[LATENCY_SAMPLES];
+
+    pthread_mutex_lock(&lat.lock);
+    size_t n = lat.total < LATENCY_SAMPLES ? lat.total : LATENCY_SAMPLES;
+    memcpy(copia, lat.muestras, n * sizeof(double));
+    pthread_mutex_unlock(&lat.lock);
+    if (n == 0) {
+        return;
     }
-    
-    return MHD_YES;
+
+    qsort(copia, n, sizeof(double), comparar_double);
+    printf("  %s: p50 %.2f ms, p99 %.2f ms (%zu muestras)\n",
+           etiqueta, copia[n / 2], copia[(n * 99) / 100], n);
 }
 
-// Escapa HTML para prevenir XSS
-char *escape_html(const char *input) {
-    char *output = malloc(strlen(input) * 6 + 1);
-    char *ptr = output;
-    
-    for (; *input; input++) {
-        switch(*input) {
-            case '&': strcpy(ptr, "&amp;"); ptr += 5; break;
-            case '<': strcpy(ptr, "&lt;");  ptr += 4; break;
-            case '>': strcpy(ptr, "&gt;");  ptr += 4; break;
-            default: *ptr++ = *input;
+static void *hash_worker(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&hasher.lock);
+        while (hasher.pendientes == 0 && !hasher.parar) {
+            pthread_cond_wait(&hasher.hay_trabajo, &hasher.lock);
+        }
+        if (hasher.pendientes == 0) {
+            pthread_mutex_unlock(&hasher.lock);
+            return NULL;
         }
+        struct hash_job *job = hasher.cola[hasher.cabeza];
+        hasher.cabeza = (hasher.cabeza + 1) % HASH_QUEUE_LEN;
+        hasher.pendientes--;
+        hasher.en_curso++;
+        pthread_mutex_unlock(&hasher.lock);
+
+        // Consulta + KDF lento fuera de los hilos HTTP
+        int result = check_credentials(job->username, job->password);
+        registrar_latencia(ms_desde(&job->encolado));
+
+        // Leer el callback antes de publicar el resultado: el trabajo puede liberarse después
+        void (*on_done)(struct hash_job *) = job->on_done;
+        pthread_mutex_lock(&hasher.lock);
+        job->result = result;
+        job->done = 1;
+        pthread_cond_broadcast(&hasher.terminado);
+        pthread_mutex_unlock(&hasher.lock);
+        if (on_done) {
+            on_done(job);
+        }
+
+        pthread_mutex_lock(&hasher.lock);
+        if (--hasher.en_curso == 0 && hasher.pendientes == 0) {
+            pthread_cond_broadcast(&hasher.terminado);
+        }
+        pthread_mutex_unlock(&hasher.lock);
+    }
+}
+
+int hash_pool_init(void) {
+    for (int i = 0; i < HASH_WORKERS; i++) {
+        if (pthread_create(&hasher.workers[i], NULL, hash_worker, NULL) != 0) {
+            fprintf(stderr, "Error al crear hilo de hashing\n");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Espera a que no quede ningún trabajo encolado ni en curso. Hay que llamarla
+// (o hash_pool_destroy) antes de MHD_stop_daemon: un trabajo pendiente apunta
+// al con_info de una conexión suspendida y termina con MHD_resume_connection
+static void hash_pool_drenar(void) {
+    pthread_mutex_lock(&hasher.lock);
+    while (hasher.pendientes > 0 || hasher.en_curso > 0) {
+        pthread_cond_wait(&hasher.terminado, &hasher.lock);
     }
-    *ptr = '\0';
-    return output;
+    pthread_mutex_unlock(&hasher.lock);
 }
 
-// Respuesta HTTP segura
-static int send_response(struct MHD_Connection *connection, const char *message, int status_code) {
-    char *escaped = escape_html(message);
+// Termina los trabajos pendientes y para los hilos; los envíos posteriores
+// se rechazan y la conexión se reanuda con error
+void hash_pool_destroy(void) {
+    pthread_mutex_lock(&hasher.lock);
+    hasher.parar = 1;
+    pthread_cond_broadcast(&hasher.hay_trabajo);
+    pthread_mutex_unlock(&hasher.lock);
+    for (int i = 0; i < HASH_WORKERS; i++) {
+        pthread_join(hasher.workers[i], NULL);
+    }
+}
+
+// Encola una verificación; devuelve 0 si la cola está llena
+static int hash_pool_submit(struct hash_job *job) {
+    clock_gettime(CLOCK_MONOTONIC, &job->encolado);
+    job->done = 0;
+
+    pthread_mutex_lock(&hasher.lock);
+    if (hasher.pendientes == HASH_QUEUE_LEN || hasher.parar) {
+        pthread_mutex_unlock(&hasher.lock);
+        return 0;
+    }
+    hasher.cola[(hasher.cabeza + hasher.pendientes) % HASH_QUEUE_LEN] = job;
+    hasher.pendientes++;
+    pthread_cond_signal(&hasher.hay_trabajo);
+    pthread_mutex_unlock(&hasher.lock);
+    return 1;
+}
+
+// Versión bloqueante usada por el benchmark de carga concurrente
+static int check_credentials_async(const char *username, const char *password) {
+    struct hash_job job = {.username = username, .password = password};
+    if (!hash_pool_submit(&job)) {
+        return -1;
+    }
+    pthread_mutex_lock(&hasher.lock);
+    while (!job.done) {
+        pthread_cond_wait(&hasher.terminado, &hasher.lock);
+    }
+    pthread_mutex_unlock(&hasher.lock);
+    return job.result;
+}
+
+struct bench_args {
+    int (*verificar)(const char *, const char *);
+    const char *username;
+    const char *password;
+    int iteraciones;
+};
+
+static void *bench_worker(void *arg) {
+    struct bench_args *a = arg;
+    for (int i = 0; i < a->iteraciones; i++) {
+        a->verificar(a->username, a->password);
+    }
+    return NULL;
+}
+
+static double bench_logins(int (*verificar)(const char *, const char *),
+                           const char *username, const char *password,
+                           int hilos, int iteraciones) {
+    pthread_t tids[64];
+    struct bench_args args = {verificar, username, password, iteraciones};
+    struct timespec t0, t1;
+
+    if (hilos > 64) hilos = 64;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < hilos; i++) {
+        pthread_create(&tids[i], NULL, bench_worker, &args);
+    }
+    for (int i = 0; i < hilos; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double segundos = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    return (double)hilos * iteraciones / segundos;
+}
+
+// Compara logins/s con y sin pool (y con la caché aparte) contra la base de datos local
+static int run_benchmark(const char *username, const char *password, int hilos, int iteraciones) {
+    printf("Benchmark: %d hilos x %d logins (usuario '%s')\n", hilos, iteraciones, username);
+    double sin_pool = bench_logins(check_credentials_sin_pool, username, password, hilos, iteraciones);
+    printf("  conexión por login: %.1f logins/s\n", sin_pool);
+    double con_pool = bench_logins(check_credentials_sin_cache, username, password, hilos, iteraciones);
+    printf("  pool de %d conexiones: %.1f logins/s (x%.2f)\n",
+           POOL_SIZE, con_pool, sin_pool > 0 ? con_pool / sin_pool : 0.0);
+    cred_cache_invalidate(username);
+    double con_cache = bench_logins(check_credentials, username, password, hilos, iteraciones);
+    printf("  pool + caché de credenciales: %.1f logins/s (x%.2f)\n",
+           con_cache, con_pool > 0 ? con_cache / con_pool : 0.0);
+
+    pthread_mutex_lock(&lat.lock);
+    lat.total = 0;
+    pthread_mutex_unlock(&lat.lock);
+    double asincrono = bench_logins(check_credentials_async, username, password, hilos, iteraciones);
+    printf("  pool de hashing + caché (%d hilos, cola %d): %.1f logins/s\n",
+           HASH_WORKERS, HASH_QUEUE_LEN, asincrono);
+    reportar_latencias("latencia de verificación");
+    cred_cache_report();
+    return 0;
+}
+
+int con_info_pool_init(unsigned int n) {
+    con_infos.slots = calloc(n, sizeof(struct connection_info));
+    if (!con_infos.slots) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        con_infos.slots[i].siguiente = (i + 1 < n) ? &con_infos.slots[i + 1] : NULL;
+    }
+    con_infos.libres = &con_infos.slots[0];
+    return 1;
+}
+
+static struct connection_info *con_info_acquire(void) {
+    pthread_mutex_lock(&con_infos.lock);
+    struct connection_info *ci = con_infos.libres;
+    if (ci) {
+        con_infos.libres = ci->siguiente;
+    }
+    pthread_mutex_unlock(&con_infos.lock);
+    return ci;
+}
+
+static void con_info_release(struct connection_info *ci) {
+    pthread_mutex_lock(&con_infos.lock);
+    ci->siguiente = con_infos.libres;
+    con_infos.libres = ci;
+    pthread_mutex_unlock(&con_infos.lock);
+}
+
+// Devuelve el estado a la arena al terminar la petición, también si se aborta
+static void request_completed(void *cls, struct MHD_Connection *connection,
+                              void **con_cls, enum MHD_RequestTerminationCode toe) {
+    (void)cls;
+    (void)connection;
+    (void)toe;
+    if (*con_cls) {
+        con_info_release(*con_cls);
+        *con_cls = NULL;
+    }
+}
+
+// Comprime el cuerpo en formato gzip; devuelve 0 si no merece la pena
+static size_t comprimir_gzip(const char *datos, size_t len, unsigned char **salida) {
+    z_stream zs = {0};
+    if (len < GZIP_MIN_LEN ||
+        deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return 0;
+    }
+
+    size_t cap = deflateBound(&zs, (uLong)len);
+    unsigned char *buf = malloc(cap);
+    if (!buf) {
+        deflateEnd(&zs);
+        return 0;
+    }
+    zs.next_in = (Bytef *)datos;
+    zs.avail_in = (uInt)len;
+    zs.next_out = buf;
+    zs.avail_out = (uInt)cap;
+    int ret = deflate(&zs, Z_FINISH);
+    size_t total = zs.total_out;
+    deflateEnd(&zs);
+
+    if (ret != Z_STREAM_END || total >= len) {
+        free(buf);
+        return 0;
+    }
+    *salida = buf;
+    return total;
+}
+
+static struct MHD_Response *crear_respuesta(const void *datos, size_t len, const char *content_type) {
+    struct MHD_Response *r = MHD_create_response_from_buffer(len, (void *)datos, MHD_RESPMEM_PERSISTENT);
+    if (r) {
+        MHD_add_response_header(r, MHD_HTTP_HEADER_CONTENT_TYPE, content_type);
+        MHD_add_response_header(r, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+    }
+    return r;
+}
+
+// Crea todas las respuestas fijas (y su variante gzip) una sola vez
+int respuestas_init(int usar_gzip) {
+    for (int i = 0; i < NUM_RESPUESTAS; i++) {
+        struct respuesta_estatica *r = &respuestas[i];
+        size_t len = strlen(r->cuerpo);
+
+        r->plano = crear_respuesta(r->cuerpo, len, r->content_type);
+        if (!r->plano) {
+            return 0;
+        }
+        if (!usar_gzip) {
+            continue;
+        }
+        size_t gz_len = comprimir_gzip(r->cuerpo, len, &r->gzip_buf);
+        if (gz_len > 0) {
+            r->gzip = crear_respuesta(r->gzip_buf, gz_len, r->content_type);
+            if (r->gzip) {
+                MHD_add_response_header(r->gzip, MHD_HTTP_HEADER_CONTENT_ENCODING, "gzip");
+            }
+        }
+    }
+    return 1;
+}
+
+void respuestas_destroy(void) {
+    for (int i = 0; i < NUM_RESPUESTAS; i++) {
+        if (respuestas[i].plano) {
+            MHD_destroy_response(respuestas[i].plano);
+        }
+        if (respuestas[i].gzip) {
+            MHD_destroy_response(respuestas[i].gzip);
+        }
+        free(respuestas[i].gzip_buf);
+        respuestas[i].plano = respuestas[i].gzip = NULL;
+        respuestas[i].gzip_buf = NULL;
+    }
+}
+
+// Encola una respuesta compartida; MHD mantiene la conexión viva (keep-alive)
+// salvo que el cliente pida cerrarla
+static int send_response(struct MHD_Connection *connection, enum respuesta id) {
+    struct respuesta_estatica *r = &respuestas[id];
+    struct MHD_Response *response = r->plano;
+
+    if (r->gzip) {
+        const char *ae = MHD_lookup_connection_value(connection, MHD_HEADER_KIND,
+                                                     MHD_HTTP_HEADER_ACCEPT_ENCODING);
+        if (ae && strstr(ae, "gzip")) {
+            response = r->gzip;
+        }
+    }
+    return MHD_queue_response(connection, r->status, response);
+}
+
+// Login correcto: emite un token de sesión opaco en una cookie
+static int send_login_ok(struct MHD_Connection *connection, const char *username) {
+    char token[SESSION_TOKEN_HEX + 1];
+    char cookie[SESSION_TOKEN_HEX + 96];
+
+    if (!session_create(username, token)) {
+        return send_response(connection, RESP_SATURADO);
+    }
+    snprintf(cookie, sizeof(cookie), "session=%s; Max-Age=%d; Path=/; Secure; HttpOnly; SameSite=Strict",
+             token, SESSION_TTL);
+
+    const char *cuerpo = respuestas[RESP_LOGIN_OK].cuerpo;
     struct MHD_Response *response = MHD_create_response_from_buffer(
-        strlen(escaped), escaped, MHD_RESPMEM_MUST_FREE);
-    
-    int ret = MHD_queue_response(connection, status_code, response);
+        strlen(cuerpo), (void *)cuerpo, MHD_RESPMEM_PERSISTENT);
+    if (!response) {
+        return MHD_NO;
+    }
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, respuestas[RESP_LOGIN_OK].content_type);
+    MHD_add_response_header(response, MHD_HTTP_HEADER_SET_COOKIE, cookie);
+    int ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
     MHD_destroy_response(response);
     return ret;
 }
 
+// Reanuda la conexión suspendida una vez calculado el hash
+static void reanudar_conexion(struct hash_job *job) {
+    MHD_resume_connection((struct MHD_Connection *)job->ctx);
+}
+
 // Callback principal mejorado
 static int answer_to_connection(void *cls, struct MHD_Connection *connection,
                                const char *url, const char *method,
                                const char *version, const char *upload_data,
                                size_t *upload_data_size, void **con_cls) {
     
+    // Peticiones autenticadas: se validan contra el almacén de sesiones, sin base de datos
+    if (strcmp(url, "/sesion") == 0 || strcmp(url, "/logout") == 0) {
+        const char *token = MHD_lookup_connection_value(connection, MHD_COOKIE_KIND, "session");
+        if (strcmp(url, "/logout") == 0) {
+            if (strcmp(method, "POST") != 0) {
+                return send_response(connection, RESP_NO_PERMITIDO);
+            }
+            session_revoke(token);
+            return send_response(connection, RESP_SESION_CERRADA);
+        }
+        if (strcmp(method, "GET") != 0) {
+            return send_response(connection, RESP_NO_PERMITIDO);
+        }
+        return send_response(connection, session_validate(token, NULL, 0) ? RESP_SESION_OK
+                                                                          : RESP_NO_AUTORIZADO);
+    }
+
     if (strcmp(url, "/login") != 0) {
-        return send_response(connection, "Ruta no encontrada", MHD_HTTP_NOT_FOUND);
+        return send_response(connection, RESP_NO_ENCONTRADA);
     }
 
     if (strcmp(method, "GET") == 0) {
-        const char *form = "<form method=\"post\">[...]</form>";
-        return send_response(connection, form, MHD_HTTP_OK);
+        return send_response(connection, RESP_FORM);
     }
     else if (strcmp(method, "POST") == 0) {
         struct connection_info *con_info = *con_cls;
         
         if (!con_info) {
-            con_info = calloc(1, sizeof(struct connection_info));
+            con_info = con_info_acquire();
+            if (!con_info) {
+                return send_response(connection, RESP_SATURADO);
+            }
+            memset(con_info, 0, sizeof(*con_info));
+            form_parser_init(&con_info->form,
+                             form_tipo_de(MHD_lookup_connection_value(connection, MHD_HEADER_KIND,
+                                                                      MHD_HTTP_HEADER_CONTENT_TYPE)));
             *con_cls = con_info;
             return MHD_YES;
         }
 
+        // Los campos pueden llegar partidos entre fragmentos: el parser guarda el estado
         if (*upload_data_size != 0) {
-            MHD_post_process(con_info, upload_data, *upload_data_size);
+            if (form_parser_feed(&con_info->form, upload_data, *upload_data_size) < 0) {
+                con_info->cuerpo_invalido = 1;
+            }
             *upload_data_size = 0;
             return MHD_YES;
         }
 
-        con_info->login_success = check_credentials(con_info->username, con_info->password);
-        
-        const char *msg = con_info->login_success ? 
-            "Login exitoso" : "Credenciales inválidas";
-        
-        int ret = send_response(connection, msg, MHD_HTTP_OK);
+        if (!con_info->en_cola &&
+            (con_info->cuerpo_invalido || form_parser_finish(&con_info->form) < 0)) {
+            return send_response(connection, RESP_INVALIDA);
+        }
+
+        // Suspender la conexión mientras el pool de hashing verifica
+        if (!con_info->en_cola) {
+            con_info->en_cola = 1;
+            con_info->job.username = con_info->form.username;
+            con_info->job.password = con_info->form.password;
+            con_info->job.on_done = reanudar_conexion;
+            con_info->job.ctx = connection;
+            MHD_suspend_connection(connection);
+            if (!hash_pool_submit(&con_info->job)) {
+                con_info->job.result = -1;
+                con_info->job.done = 1;
+                MHD_resume_connection(connection);
+            }
+            return MHD_YES;
+        }
+
+        if (con_info->job.result < 0) {
+            return send_response(connection, RESP_SATURADO);
+        }
+        con_info->login_success = con_info->job.result;
         
-        free(con_info);
-        *con_cls = NULL;
-        return ret;
+        if (con_info->login_success) {
+            return send_login_ok(connection, con_info->form.username);
+        }
+        return send_response(connection, RESP_LOGIN_FALLO);
     }
     
-    return send_response(connection, "Método no permitido", MHD_HTTP_METHOD_NOT_ALLOWED);
+    return send_response(connection, RESP_NO_PERMITIDO);
+}
+
+// Lee un fichero PEM completo; MHD espera el contenido, no la ruta
+static char *leer_pem(const char *ruta) {
+    FILE *f = fopen(ruta, "r");
+    if (!f) {
+        perror(ruta);
+        return NULL;
+    }
+    // El buffer se dimensiona con el tamaño real: truncar el PEM daría un error de TLS confuso
+    struct stat st;
+    if (fstat(fileno(f), &st) < 0 || st.st_size <= 0 || st.st_size > MAX_PEM_LEN) {
+        fprintf(stderr, "%s: tamaño no válido (máximo %d bytes)\n", ruta, MAX_PEM_LEN);
+        fclose(f);
+        return NULL;
+    }
+    size_t len = (size_t)st.st_size;
+    char *pem = malloc(len + 1);
+    size_t n = pem ? fread(pem, 1, len, f) : 0;
+    fclose(f);
+    if (n != len) {
+        fprintf(stderr, "%s: lectura incompleta\n", ruta);
+        free(pem);
+        return NULL;
+    }
+    pem[len] = '\0';
+    return pem;
+}
+
+static struct MHD_Daemon *iniciar_demonio(const struct server_config *cfg,
+                                          const char *key_pem, const char *cert_pem) {
+    unsigned int flags = MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_TLS | MHD_ALLOW_SUSPEND_RESUME;
+    if (cfg->hilos > 1) {
+        flags |= MHD_USE_EPOLL;
+    }
+
+    return MHD_start_daemon(flags, PORT, NULL, NULL,
+                            &answer_to_connection, NULL,
+                            MHD_OPTION_HTTPS_MEM_KEY, key_pem,
+                            MHD_OPTION_HTTPS_MEM_CERT, cert_pem,
+                            MHD_OPTION_THREAD_POOL_SIZE, cfg->hilos > 1 ? cfg->hilos : 0,
+                            MHD_OPTION_CONNECTION_LIMIT, cfg->max_conexiones,
+                            MHD_OPTION_PER_IP_CONNECTION_LIMIT, cfg->por_ip,
+                            MHD_OPTION_CONNECTION_TIMEOUT, cfg->timeout,
+                            MHD_OPTION_CONNECTION_MEMORY_LIMIT, cfg->limite_memoria,
+                            MHD_OPTION_NOTIFY_COMPLETED, &request_completed, NULL,
+                            MHD_OPTION_END);
 }
 
-int main() {
+struct carga_args {
+    SSL_CTX *ctx;
+    int peticiones;
+    int keep_alive;
+    int gzip;
+    int completadas;
+};
+
+// Lee una respuesta completa (cabeceras + Content-Length); devuelve 1 si fue 200
+static int leer_respuesta(SSL *ssl) {
+    char buf[8192];
+    int total = 0, n;
+    char *fin_cabeceras = NULL;
+
+    while (!fin_cabeceras && total < (int)sizeof(buf) - 1) {
+        n = SSL_read(ssl, buf + total, (int)sizeof(buf) - 1 - total);
+        if (n <= 0) {
+            return 0;
+        }
+        total += n;
+        buf[total] = '\0';
+        fin_cabeceras = strstr(buf, "\r\n\r\n");
+    }
+    if (!fin_cabeceras) {
+        return 0;
+    }
+
+    int ok = strncmp(buf, "HTTP/1.1 200", 12) == 0 || strncmp(buf, "HTTP/1.0 200", 12) == 0;
+    const char *cl = strstr(buf, "\r\nContent-Length:");
+    long restante = (cl ? strtol(cl + 17, NULL, 10) : 0) - (long)(buf + total - (fin_cabeceras + 4));
+    while (restante > 0) {
+        n = SSL_read(ssl, buf, (int)sizeof(buf));
+        if (n <= 0) {
+            return 0;
+        }
+        restante -= n;
+    }
+    return ok;
+}
+
+// Cliente TLS de prueba: GET /login con una conexión por petición o con keep-alive
+static void *cliente_carga(void *arg) {
+    struct carga_args *a = arg;
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(PORT)};
+    char req[256];
+    int req_len = snprintf(req, sizeof(req),
+                           "GET /login HTTP/1.1\r\nHost: localhost\r\n%s%s\r\n",
+                           a->keep_alive ? "" : "Connection: close\r\n",
+                           a->gzip ? "Accept-Encoding: gzip\r\n" : "");
+    SSL *ssl = NULL;
+    int fd = -1;
+
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    for (int i = 0; i < a->peticiones; i++) {
+        if (!ssl) {
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+                if (fd >= 0) close(fd);
+                continue;
+            }
+            ssl = SSL_new(a->ctx);
+            SSL_set_fd(ssl, fd);
+            if (SSL_connect(ssl) != 1) {
+                SSL_free(ssl);
+                close(fd);
+                ssl = NULL;
+                continue;
+            }
+        }
+
+        int ok = SSL_write(ssl, req, req_len) > 0 && leer_respuesta(ssl);
+        a->completadas += ok;
+        if (!ok || !a->keep_alive) {
+            SSL_free(ssl);
+            close(fd);
+            ssl = NULL;
+        }
+    }
+    if (ssl) {
+        SSL_free(ssl);
+        close(fd);
+    }
+    return NULL;
+}
+
+// Arranca el demonio con 1, 4 y 16 hilos y mide peticiones/s contra el formulario
+static int run_loadtest(struct server_config cfg, const char *key_pem, const char *cert_pem,
+                        int clientes, int peticiones) {
+    static const unsigned int hilos[] = {1, 4, 16};
+    pthread_t tids[256];
+    struct carga_args args[256];
+
+    if (clientes < 1 || clientes > 256 || peticiones < 1) {
+        fprintf(stderr, "Parámetros de carga inválidos\n");
+        return 1;
+    }
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (!ctx) {
+        return 1;
+    }
+
+    // Todos los clientes salen de 127.0.0.1: no aplicar el límite por IP
+    cfg.por_ip = 0;
+    printf("Carga: %d clientes x %d peticiones GET /login\n", clientes, peticiones);
+    for (size_t h = 0; h < sizeof(hilos) / sizeof(hilos[0]); h++) {
+        cfg.hilos = hilos[h];
+        struct MHD_Daemon *d = iniciar_demonio(&cfg, key_pem, cert_pem);
+        if (!d) {
+            fprintf(stderr, "Error al iniciar servidor con %u hilos\n", cfg.hilos);
+            continue;
+        }
+
+        // Sin keep-alive, con keep-alive y con keep-alive + gzip
+        for (int modo = 0; modo < 3; modo++) {
+            struct timespec t0;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            for (int i = 0; i < clientes; i++) {
+                args[i] = (struct carga_args){ctx, peticiones, modo > 0, modo == 2, 0};
+                pthread_create(&tids[i], NULL, cliente_carga, &args[i]);
+            }
+            int ok = 0;
+            for (int i = 0; i < clientes; i++) {
+                pthread_join(tids[i], NULL);
+                ok += args[i].completadas;
+            }
+            double ms = ms_desde(&t0);
+
+            static const char *modos[] = {"conexión por petición", "keep-alive", "keep-alive + gzip"};
+            printf("  %2u hilos, %-22s: %.1f peticiones/s (%d/%d correctas)\n",
+                   cfg.hilos, modos[modo], ok * 1000.0 / ms, ok, clientes * peticiones);
+        }
+        hash_pool_drenar();
+        MHD_stop_daemon(d);
+    }
+    SSL_CTX_free(ctx);
+    return 0;
+}
+
+static void uso(const char *prog) {
+    fprintf(stderr,
+            "Uso: %s [--threads N] [--max-conns N] [--per-ip N] [--timeout S] [--mem-limit BYTES]\n"
+            "          [--no-gzip]\n"
+            "          [--bench <usuario> <password> <hilos> <iteraciones>]\n"
+            "          [--loadtest <clientes> <peticiones>]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
     struct MHD_Daemon *daemon;
+    struct server_config cfg = {
+        .hilos = 1,
+        .max_conexiones = 1024,
+        .por_ip = 16,
+        .timeout = 30,
+        .limite_memoria = 32 * 1024
+    };
+    char **bench = NULL;
+    char **carga = NULL;
+    int usar_gzip = 1;
+
+    for (int i = 1; i < argc; i++) {
+        unsigned long valor;
+        if (strcmp(argv[i], "--no-gzip") == 0) {
+            usar_gzip = 0;
+            continue;
+        }
+        if (strcmp(argv[i], "--bench") == 0 && i + 4 < argc) {
+            bench = &argv[i + 1];
+            i += 4;
+            continue;
+        }
+        if (strcmp(argv[i], "--loadtest") == 0 && i + 2 < argc) {
+            carga = &argv[i + 1];
+            i += 2;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            uso(argv[0]);
+            return 1;
+        }
+        char *fin;
+        valor = strtoul(argv[i + 1], &fin, 10);
+        if (*fin != '\0') {
+            uso(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "--threads") == 0 && valor >= 1 && valor <= 256) {
+            cfg.hilos = (unsigned int)valor;
+        } else if (strcmp(argv[i], "--max-conns") == 0 && valor >= 1) {
+            cfg.max_conexiones = (unsigned int)valor;
+        } else if (strcmp(argv[i], "--per-ip") == 0) {
+            cfg.por_ip = (unsigned int)valor;
+        } else if (strcmp(argv[i], "--timeout") == 0) {
+            cfg.timeout = (unsigned int)valor;
+        } else if (strcmp(argv[i], "--mem-limit") == 0 && valor >= 4096) {
+            cfg.limite_memoria = (size_t)valor;
+        } else {
+            uso(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    char *key_pem = leer_pem("server.key");
+    char *cert_pem = leer_pem("server.crt");
+    if (!bench && (!key_pem || !cert_pem)) {
+        fprintf(stderr, "Error al leer server.key / server.crt\n");
+        free(key_pem);
+        free(cert_pem);
+        return 1;
+    }
+
+    if (!con_info_pool_init(cfg.max_conexiones) || !respuestas_init(usar_gzip)) {
+        fprintf(stderr, "Error al reservar la arena de conexiones o las respuestas\n");
+        free(key_pem);
+        free(cert_pem);
+        return 1;
+    }
+
+    // La prueba de carga sólo sirve el formulario estático: no necesita base de datos
+    if (carga) {
+        int ret = run_loadtest(cfg, key_pem, cert_pem, atoi(carga[0]), atoi(carga[1]));
+        free(key_pem);
+        free(cert_pem);
+        return ret;
+    }
+
+    cred_cache_init();
+    session_store_init();
+    if (!pool_init()) {
+        fprintf(stderr, "Error al inicializar el pool de conexiones\n");
+        return 1;
+    }
+    if (!hash_pool_init()) {
+        pool_destroy();
+        return 1;
+    }
+
+    if (bench) {
+        int ret = run_benchmark(bench[0], bench[1], atoi(bench[2]), atoi(bench[3]));
+        hash_pool_destroy();
+        pool_destroy();
+        free(key_pem);
+        free(cert_pem);
+        return ret;
+    }
     
-    daemon = MHD_start_daemon(MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_TLS,
-                             PORT, NULL, NULL,
-                             &answer_to_connection, NULL,
-                             MHD_OPTION_HTTPS_MEM_KEY, "server.key",
-                             MHD_OPTION_HTTPS_MEM_CERT, "server.crt",
-                             MHD_OPTION_END);
+    daemon = iniciar_demonio(&cfg, key_pem, cert_pem);
     
     if (!daemon) {
         fprintf(stderr, "Error al iniciar servidor\n");
+        hash_pool_destroy();
+        pool_destroy();
         return 1;
     }
 
-    printf("Servidor seguro en https://localhost:%d\n", PORT);
+    printf("Servidor seguro en https://localhost:%d (%u hilos, %u conexiones por IP)\n",
+           PORT, cfg.hilos, cfg.por_ip);
     getchar();
     
+    // Primero el pool: sus trabajos reanudan conexiones suspendidas que el
+    // demonio liberaría (request_completed) si se parase antes
+    hash_pool_destroy();
     MHD_stop_daemon(daemon);
+    reportar_latencias("latencia de verificación");
+    cred_cache_report();
+    pool_destroy();
+    respuestas_destroy();
+    free(key_pem);
+    free(cert_pem);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,247 @@
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+
+// Almacén de sesiones en memoria compartido por los servidores de caso5.
+// Los tokens son opacos (32 bytes aleatorios en hexadecimal); la validación es
+// una búsqueda hash O(1) en un shard y la caducidad la gestiona una rueda de
+// temporización por shard, sin recorrer todas las entradas.
+
+#define SESSION_TOKEN_BYTES 32
+#define SESSION_TOKEN_HEX (SESSION_TOKEN_BYTES * 2)
+#define SESSION_USER_MAX 100
+#define SESSION_TTL 1800          // Segundos de validez de una sesión
+#define SESSION_SHARDS 16
+#define SESSION_PER_SHARD 2048    // Sesiones simultáneas por shard
+#define SESSION_BUCKETS 2048      // Potencia de dos
+#define WHEEL_TICK 30             // Resolución de la rueda en segundos
+#define WHEEL_SLOTS 64            // WHEEL_SLOTS * WHEEL_TICK debe superar SESSION_TTL
+
+struct session_entry {
+    unsigned char token[SESSION_TOKEN_BYTES];
+    char username[SESSION_USER_MAX + 1];
+    time_t expira;
+    int en_uso;
+    int sig_bucket;               // Cadena del bucket hash (-1 = fin)
+    int sig_rueda;                // Lista doble de la ranura de la rueda
+    int ant_rueda;
+    int ranura;
+};
+
+struct session_shard {
+    pthread_mutex_t lock;
+    struct session_entry entradas[SESSION_PER_SHARD];
+    int buckets[SESSION_BUCKETS];
+    int rueda[WHEEL_SLOTS];
+    int libre;                    // Lista de entradas libres enlazada por sig_bucket
+    long ultimo_tick;
+};
+
+static struct session_shard session_shards[SESSION_SHARDS];
+
+static inline void session_store_init(void) {
+    long tick = (long)(time(NULL) / WHEEL_TICK);
+    for (int s = 0; s < SESSION_SHARDS; s++) {
+        struct session_shard *sh = &session_shards[s];
+        pthread_mutex_init(&sh->lock, NULL);
+        for (int i = 0; i < SESSION_BUCKETS; i++) {
+            sh->buckets[i] = -1;
+        }
+        for (int i = 0; i < WHEEL_SLOTS; i++) {
+            sh->rueda[i] = -1;
+        }
+        for (int i = 0; i < SESSION_PER_SHARD; i++) {
+            sh->entradas[i].en_uso = 0;
+            sh->entradas[i].sig_bucket = (i + 1 < SESSION_PER_SHARD) ? i + 1 : -1;
+        }
+        sh->libre = 0;
+        sh->ultimo_tick = tick;
+    }
+}
+
+// El token es aleatorio: sus primeros bytes sirven directamente como hash
+static inline unsigned int session_bucket(const unsigned char *token) {
+    unsigned int h;
+    memcpy(&h, token + 1, sizeof(h));
+    return h & (SESSION_BUCKETS - 1);
+}
+
+static inline struct session_shard *session_shard_de(const unsigned char *token) {
+    return &session_shards[token[0] % SESSION_SHARDS];
+}
+
+static inline int session_hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static inline int session_decode(const char *hex, unsigned char *token) {
+    if (!hex || strnlen(hex, SESSION_TOKEN_HEX + 1) != SESSION_TOKEN_HEX) {
+        return 0;
+    }
+    for (int i = 0; i < SESSION_TOKEN_BYTES; i++) {
+        int hi = session_hex(hex[2 * i]);
+        int lo = session_hex(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return 0;
+        }
+        token[i] = (unsigned char)((hi << 4) | lo);
+    }
+    return 1;
+}
+
+static inline void session_desenlazar_rueda(struct session_shard *sh, int idx) {
+    struct session_entry *e = &sh->entradas[idx];
+    if (e->ant_rueda >= 0) {
+        sh->entradas[e->ant_rueda].sig_rueda = e->sig_rueda;
+    } else {
+        sh->rueda[e->ranura] = e->sig_rueda;
+    }
+    if (e->sig_rueda >= 0) {
+        sh->entradas[e->sig_rueda].ant_rueda = e->ant_rueda;
+    }
+}
+
+// Quita la entrada del hash y de la rueda y la devuelve a la lista libre
+static inline void session_liberar(struct session_shard *sh, int idx) {
+    struct session_entry *e = &sh->entradas[idx];
+    int *enlace = &sh->buckets[session_bucket(e->token)];
+    while (*enlace != idx) {
+        enlace = &sh->entradas[*enlace].sig_bucket;
+    }
+    *enlace = e->sig_bucket;
+    session_desenlazar_rueda(sh, idx);
+
+    OPENSSL_cleanse(e->token, sizeof(e->token));
+    e->en_uso = 0;
+    e->sig_bucket = sh->libre;
+    sh->libre = idx;
+}
+
+// Avanza la rueda hasta el instante actual liberando las ranuras vencidas
+static inline void session_tick(struct session_shard *sh, time_t ahora) {
+    long tick = (long)(ahora / WHEEL_TICK);
+    long pasos = tick - sh->ultimo_tick;
+    if (pasos > WHEEL_SLOTS) {
+        pasos = WHEEL_SLOTS;
+    }
+    for (long t = tick - pasos + 1; t <= tick; t++) {
+        int ranura = (int)(t % WHEEL_SLOTS);
+        int idx = sh->rueda[ranura];
+        while (idx >= 0) {
+            int siguiente = sh->entradas[idx].sig_rueda;
+            if (sh->entradas[idx].expira <= ahora) {
+                session_liberar(sh, idx);
+            }
+            idx = siguiente;
+        }
+    }
+    sh->ultimo_tick = tick;
+}
+
+static inline int session_buscar(struct session_shard *sh, const unsigned char *token) {
+    for (int idx = sh->buckets[session_bucket(token)]; idx >= 0; idx = sh->entradas[idx].sig_bucket) {
+        if (CRYPTO_memcmp(sh->entradas[idx].token, token, SESSION_TOKEN_BYTES) == 0) {
+            return idx;
+        }
+    }
+    return -1;
+}
+
+// Crea una sesión para username y escribe su token en token_hex
+// (SESSION_TOKEN_HEX + 1 bytes). Devuelve 0 si el almacén está lleno.
+static inline int session_create(const char *username, char *token_hex) {
+    unsigned char token[SESSION_TOKEN_BYTES];
+    if (RAND_bytes(token, sizeof(token)) != 1) {
+        return 0;
+    }
+
+    struct session_shard *sh = session_shard_de(token);
+    time_t ahora = time(NULL);
+
+    pthread_mutex_lock(&sh->lock);
+    session_tick(sh, ahora);
+    int idx = sh->libre;
+    if (idx < 0) {
+        pthread_mutex_unlock(&sh->lock);
+        return 0;
+    }
+    struct session_entry *e = &sh->entradas[idx];
+    sh->libre = e->sig_bucket;
+
+    memcpy(e->token, token, sizeof(token));
+    snprintf(e->username, sizeof(e->username), "%s", username);
+    e->expira = ahora + SESSION_TTL;
+    e->en_uso = 1;
+
+    unsigned int b = session_bucket(token);
+    e->sig_bucket = sh->buckets[b];
+    sh->buckets[b] = idx;
+
+    // La ranura es la del primer tick posterior a la caducidad
+    e->ranura = (int)((e->expira / WHEEL_TICK + 1) % WHEEL_SLOTS);
+    e->ant_rueda = -1;
+    e->sig_rueda = sh->rueda[e->ranura];
+    if (e->sig_rueda >= 0) {
+        sh->entradas[e->sig_rueda].ant_rueda = idx;
+    }
+    sh->rueda[e->ranura] = idx;
+    pthread_mutex_unlock(&sh->lock);
+
+    static const char digitos[] = "0123456789abcdef";
+    for (int i = 0; i < SESSION_TOKEN_BYTES; i++) {
+        token_hex[2 * i] = digitos[token[i] >> 4];
+        token_hex[2 * i + 1] = digitos[token[i] & 0x0f];
+    }
+    token_hex[SESSION_TOKEN_HEX] = '\0';
+    OPENSSL_cleanse(token, sizeof(token));
+    return 1;
+}
+
+// Devuelve 1 si el token corresponde a una sesión vigente; copia el usuario si se pide
+static inline int session_validate(const char *token_hex, char *username, size_t username_len) {
+    unsigned char token[SESSION_TOKEN_BYTES];
+    if (!session_decode(token_hex, token)) {
+        return 0;
+    }
+
+    struct session_shard *sh = session_shard_de(token);
+    time_t ahora = time(NULL);
+    int valida = 0;
+
+    pthread_mutex_lock(&sh->lock);
+    session_tick(sh, ahora);
+    int idx = session_buscar(sh, token);
+    if (idx >= 0 && sh->entradas[idx].expira > ahora) {
+        valida = 1;
+        if (username) {
+            snprintf(username, username_len, "%s", sh->entradas[idx].username);
+        }
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return valida;
+}
+
+static inline void session_revoke(const char *token_hex) {
+    unsigned char token[SESSION_TOKEN_BYTES];
+    if (!session_decode(token_hex, token)) {
+        return;
+    }
+
+    struct session_shard *sh = session_shard_de(token);
+    pthread_mutex_lock(&sh->lock);
+    int idx = session_buscar(sh, token);
+    if (idx >= 0) {
+        session_liberar(sh, idx);
+    }
+    pthread_mutex_unlock(&sh->lock);
+}
+
+#endif